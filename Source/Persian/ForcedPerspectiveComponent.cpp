@@ -0,0 +1,894 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ForcedPerspectiveComponent.h"
+#include "Persian.h"
+#include "PersianAttachableRegistry.h"
+#include "PersianCollision.h"
+#include "PersianDepthRaster.h"
+#include "PersianInstanceProxy.h"
+#include "PersianPlacementSubsystem.h"
+#include "PersianSampling.h"
+#include "PersianStaticScene.h"
+#include "Async/ParallelFor.h"
+#include "Camera/CameraComponent.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "Net/UnrealNetwork.h"
+#include "Physics/PhysicsInterfaceCore.h"
+
+#include <limits>
+
+DEFINE_LOG_CATEGORY_STATIC(LogForcedPerspective, Warning, All);
+
+DECLARE_CYCLE_STAT(TEXT("Attach"), STAT_PersianAttach, STATGROUP_Persian);
+DECLARE_CYCLE_STAT(TEXT("Attach sample extraction"), STAT_PersianAttachExtract, STATGROUP_Persian);
+DECLARE_CYCLE_STAT(TEXT("Held object compute"), STAT_PersianHeldCompute, STATGROUP_Persian);
+DECLARE_CYCLE_STAT(TEXT("MoveAttachedObject"), STAT_PersianMoveAttached, STATGROUP_Persian);
+DECLARE_CYCLE_STAT(TEXT("Placement solve"), STAT_PersianPlacementSolve, STATGROUP_Persian);
+DECLARE_CYCLE_STAT(TEXT("ScaleAttachedObject"), STAT_PersianScaleAttached, STATGROUP_Persian);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Placement rays"), STAT_PersianPlacementRays, STATGROUP_Persian);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Attach source points"), STAT_PersianAttachPoints, STATGROUP_Persian);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Held samples"), STAT_PersianHeldSamples, STATGROUP_Persian);
+
+static TAutoConsoleVariable<int32> CVarValidateSampling(
+	TEXT("persian.ValidateSampling"),
+	0,
+	TEXT("Also solve the placement against every vertex on release and warn when the sampled\n")
+	TEXT("scale differs by more than SampleTolerance. Not available in shipping builds."),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<int32> CVarVerifyHeldPose(
+	TEXT("persian.Debug.VerifyHeldPose"),
+	0,
+	TEXT("Warn whenever the held object was placed for a camera pose other than the one the frame is rendered with."),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<int32> CVarPlacementSolver(
+	TEXT("persian.PlacementSolver"),
+	-1,
+	TEXT("Overrides the placement solver of every holder.\n")
+	TEXT("-1: use the holder's PlacementSolver, 0: rays, 1: sweep and bisect, 2: depth raster"),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<float> CVarSweepPrecision(
+	TEXT("persian.SweepSolver.Precision"),
+	0.001f,
+	TEXT("Relative scale interval at which the sweep solver stops bisecting."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarParallelPlacement(
+	TEXT("persian.ParallelPlacement"),
+	1,
+	TEXT("Spread the placement rays over worker threads on release."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarBatchPlacement(
+	TEXT("persian.BatchPlacement"),
+	1,
+	TEXT("Queue the release solves of every holder to the placement subsystem, which traces them together\n")
+	TEXT("once per frame after the camera update."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNetBudget(
+	TEXT("persian.Net.BudgetBytesPerSec"),
+	64,
+	TEXT("Bytes per second and per client the server may spend replicating the held scale of one holder.\n")
+	TEXT("Grabs and releases are always sent, 0 removes the limit."),
+	ECVF_Default);
+
+//////////////////////////////////////////////////////////////////////////
+// FObjectState
+FObjectState::FObjectState() {}
+	FObjectState::FObjectState(double const& dist, FTransform const& relative,
+		EComponentMobility::Type const &mobility)
+		: Dist{ dist }, Relative{ relative }, Mobility{ mobility } {}
+
+//////////////////////////////////////////////////////////////////////////
+// FHeldObjectPrepareTickFunction
+
+void FHeldObjectPrepareTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread,
+	const FGraphEventRef& MyCompletionGraphEvent) {
+	if (this->Target != nullptr && !this->Target->IsPendingKillOrUnreachable() && TickType != LEVELTICK_ViewportsOnly) {
+		FScopeCycleCounterUObject ComponentScope(this->Target);
+		this->Target->PrepareHeldObject(DeltaTime, TickType);
+	}
+}
+
+FString FHeldObjectPrepareTickFunction::DiagnosticMessage() {
+	return this->Target->GetFullName() + TEXT("[PrepareHeldObject]");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FHeldObjectApplyTickFunction
+
+void FHeldObjectApplyTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread,
+	const FGraphEventRef& MyCompletionGraphEvent) {
+	if (this->Target != nullptr && !this->Target->IsPendingKillOrUnreachable() && TickType != LEVELTICK_ViewportsOnly) {
+		FScopeCycleCounterUObject ComponentScope(this->Target);
+		this->Target->ApplyHeldObject();
+	}
+}
+
+FString FHeldObjectApplyTickFunction::DiagnosticMessage() {
+	return this->Target->GetFullName() + TEXT("[ApplyHeldObject]");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UForcedPerspectiveComponent
+
+UForcedPerspectiveComponent::UForcedPerspectiveComponent()
+{
+	this->ViewComponent = nullptr;
+	this->PlacementGeometry = EPlacementGeometry::Collision;
+	this->SampleBudget = 1024;
+	this->SampleTolerance = 0.02f;
+	this->PlacementSolver = EPlacementSolver::Rays;
+	this->bContinuousPlacement = false;
+	this->ContinuousSolveBudgetMs = 0.3f;
+
+	this->AttachedObject = nullptr;
+	this->AttachedLocalBounds = FBox(ForceInit);
+	this->bReleasePending = false;
+	this->bReleaseSolved = false;
+	this->ReleaseScale = 0;
+	this->LastHeldScale = 0;
+	this->bHeldTransformValid = false;
+	this->PendingHeldScale = 0;
+	this->bHeldApplyPending = false;
+	this->bComputeInputStale = true;
+	this->ComputeRays = 0;
+	this->ReplicatedHeldScale = 0;
+	this->bHeldReplicatedMovement = false;
+	this->NetWindowStart = 0;
+	this->NetWindowBytes = 0;
+	this->HeldNetBytesPerSecond = 0;
+	this->State = FObjectState {
+		std::numeric_limits<double>::lowest(),
+		FTransform::Identity,
+		EComponentMobility::Movable,
+	};
+	this->ResetContinuousPlacement();
+
+	/* Prepare phase: once the camera manager has updated the view, on the game thread */
+	this->PrepareTick.bCanEverTick = true;
+	this->PrepareTick.bStartWithTickEnabled = false;
+	this->PrepareTick.TickGroup = TG_PostUpdateWork;
+	this->PrepareTick.Target = this;
+	/* Compute phase: right after it, off the game thread */
+	this->PrimaryComponentTick.bCanEverTick = true;
+	this->PrimaryComponentTick.bStartWithTickEnabled = false;
+	this->PrimaryComponentTick.bRunOnAnyThread = true;
+	this->PrimaryComponentTick.TickGroup = TG_PostUpdateWork;
+	/* Apply phase: right after it, on the game thread */
+	this->ApplyTick.bCanEverTick = true;
+	this->ApplyTick.bStartWithTickEnabled = false;
+	this->ApplyTick.TickGroup = TG_PostUpdateWork;
+	this->ApplyTick.Target = this;
+
+	this->SetIsReplicatedByDefault(true);
+}
+
+void UForcedPerspectiveComponent::OnRegister() {
+	Super::OnRegister();
+	if (this->ViewComponent == nullptr && this->GetOwner() != nullptr) {
+		this->ViewComponent = this->GetOwner()->FindComponentByClass<UCameraComponent>();
+	}
+	this->ResetPlacementQueryParams();
+}
+
+void UForcedPerspectiveComponent::RegisterComponentTickFunctions(bool bRegister) {
+	Super::RegisterComponentTickFunctions(bRegister);
+
+	if (bRegister) {
+		this->PrepareTick.Target = this;
+		if (this->SetupActorComponentTickFunction(&this->PrepareTick)) {
+			/* The flush callbacks change the held state, the prepare phase snapshots it afterwards */
+			if (UPersianPlacementSubsystem* Placement = this->GetWorld()->GetSubsystem<UPersianPlacementSubsystem>()) {
+				Placement->AddFlushPrerequisite(this->PrepareTick);
+			}
+			if (this->PrimaryComponentTick.IsTickFunctionRegistered()) {
+				this->PrimaryComponentTick.AddPrerequisite(this, this->PrepareTick);
+			}
+		}
+		this->ApplyTick.Target = this;
+		if (this->SetupActorComponentTickFunction(&this->ApplyTick)) {
+			this->ApplyTick.AddPrerequisite(this, this->PrimaryComponentTick);
+		}
+	} else {
+		if (this->PrepareTick.IsTickFunctionRegistered()) {
+			this->PrepareTick.UnRegisterTickFunction();
+		}
+		if (this->ApplyTick.IsTickFunctionRegistered()) {
+			this->ApplyTick.UnRegisterTickFunction();
+		}
+	}
+}
+
+void UForcedPerspectiveComponent::SetHeldTickEnabled(bool bEnabled) {
+	this->PrepareTick.SetTickFunctionEnable(bEnabled);
+	this->SetComponentTickEnabled(bEnabled);
+	this->ApplyTick.SetTickFunctionEnable(bEnabled);
+	this->ComputeInput.bActive = false;
+	this->bHeldApplyPending = false;
+}
+
+FTransform UForcedPerspectiveComponent::GetViewTransform() const {
+	AActor const* Owner = this->GetOwner();
+	FTransform View = this->ViewComponent != nullptr ? this->ViewComponent->GetComponentTransform()
+		: Owner != nullptr ? Owner->GetActorTransform() : FTransform::Identity;
+	View.SetScale3D(FVector::OneVector);
+	APawn const* Pawn = Cast<APawn>(Owner);
+	if (Pawn != nullptr && this->GetNetMode() != NM_Standalone && !Pawn->IsLocallyControlled()) {
+		/* No view is computed for this pawn here, follow its replicated aim */
+		View.SetRotation(Pawn->GetBaseAimRotation().Quaternion());
+	}
+	return View;
+}
+
+void UForcedPerspectiveComponent::PrepareHeldObject(float DeltaTime, ELevelTick TickType) {
+	/* Blueprint tick of the component, which must not run along with the compute phase on a worker */
+	UActorComponent::TickComponent(DeltaTime, TickType, &this->PrimaryComponentTick);
+	FHeldComputeInput& In = this->ComputeInput;
+	In.bActive = this->AttachedObject != nullptr && !this->bReleaseSolved;
+	if (!In.bActive) {
+		return;
+	}
+	In.View = this->GetViewTransform();
+	In.State = this->State;
+	if (this->bComputeInputStale) {
+		In.Directions = this->Directions;
+		In.QueryParams = this->PlacementQueryParams;
+		this->bComputeInputStale = false;
+	}
+	if (this->GetOwnerRole() == ROLE_SimulatedProxy) {
+		/* Held by another client, its scale comes from the server */
+		In.Scale = PersianNet::DequantizeScale(this->ReplicatedHeldScale);
+	} else if (!this->bContinuousPlacement) {
+		In.Scale = 30.0 / this->State.Dist;
+	} else if (this->GetPlacementSolver() == EPlacementSolver::Rays) {
+		/* Time-sliced over frames by the compute phase */
+		In.Scale = -1;
+	} else {
+		/* Cheap enough to run whole every frame, but they gather and read primitives, which is game-thread work */
+		this->ContinuousScale = this->GetPlacementSolver() == EPlacementSolver::SweepBisect
+			? this->SolveSweepScale(50000) : this->SolveRasterScale(50000);
+		In.Scale = this->GetHeldScale();
+	}
+}
+
+void UForcedPerspectiveComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) {
+	/*
+	 * No Super, the prepare phase runs the Blueprint tick.  Reads the compute
+	 * input and traces the scene only, everything it writes is read back by
+	 * ApplyHeldObject.
+	 */
+	this->bHeldApplyPending = false;
+	FHeldComputeInput const& In = this->ComputeInput;
+	if (!In.bActive) {
+		return;
+	}
+	PERSIAN_SCOPED_TIMING(HeldCompute);
+	double Scale = In.Scale;
+	if (Scale < 0) {
+		this->StepContinuousPlacement(In.View);
+		/* As GetHeldScale, from the snapshot */
+		Scale = this->ContinuousScale < 0 ? 30.0 / In.State.Dist : FMath::Min(this->ContinuousScale, this->ContinuousPassMin);
+	}
+	this->PendingHeldTransform = this->ComputeHeldTransform(Scale, In.View, In.State);
+	this->PendingHeldView = In.View;
+	this->PendingHeldScale = Scale;
+	this->bHeldApplyPending = true;
+}
+
+void UForcedPerspectiveComponent::ApplyHeldObject() {
+	/* Counted here, the compute phase must not touch the stats */
+	INC_DWORD_STAT_BY(STAT_PersianPlacementRays, this->ComputeRays);
+	this->ComputeRays = 0;
+	if (this->AttachedObject == nullptr) {
+		return;
+	}
+	if (this->bReleaseSolved) {
+		this->bReleaseSolved = false;
+		this->bReleasePending = false;
+		this->ScaleAttachedObject(this->ReleaseScale);
+		this->FinishRelease();
+		return;
+	}
+	/* Nothing to do when neither the view nor the scale moved */
+	if (this->bHeldApplyPending && !(this->bHeldTransformValid && this->LastHeldScale == this->PendingHeldScale
+			&& this->LastHeldCamTransform.Equals(this->PendingHeldView, 0))) {
+		PERSIAN_SCOPED_TIMING(ScaleAttached);
+		this->LastHeldCamTransform = this->PendingHeldView;
+		this->LastHeldScale = this->PendingHeldScale;
+		this->bHeldTransformValid = true;
+		/* Update object scale, position and orientation at once, without sweeping or encroachment checks */
+		this->AttachedObject->SetActorTransform(this->PendingHeldTransform, false, nullptr, ETeleportType::TeleportPhysics);
+	}
+	this->bHeldApplyPending = false;
+	if (this->GetOwner()->HasAuthority()) {
+		this->PublishHeldScale(this->LastHeldScale);
+	}
+
+#if !UE_BUILD_SHIPPING
+	if (CVarVerifyHeldPose.GetValueOnGameThread() != 0) {
+		APawn const* Pawn = Cast<APawn>(this->GetOwner());
+		APlayerController const* PC = Pawn != nullptr ? Cast<APlayerController>(Pawn->GetController()) : nullptr;
+		if (PC != nullptr && PC->PlayerCameraManager != nullptr && PC->PlayerCameraManager->GetViewTarget() == Pawn) {
+			/* The view of this frame is final by now, the held object must have been placed for it */
+			FMinimalViewInfo const& POV = PC->PlayerCameraManager->GetCameraCachePOV();
+			if (!this->LastHeldCamTransform.GetLocation().Equals(POV.Location, 0.1f)
+				|| !this->LastHeldCamTransform.Rotator().Equals(POV.Rotation, 0.1f)) {
+				UE_LOG(LogForcedPerspective, Warning, TEXT("Held object placed for camera %s %s, frame rendered from %s %s"),
+					*this->LastHeldCamTransform.GetLocation().ToString(), *this->LastHeldCamTransform.Rotator().ToString(),
+					*POV.Location.ToString(), *POV.Rotation.ToString());
+			}
+		}
+	}
+#endif
+}
+
+double UForcedPerspectiveComponent::GetHeldScale() const {
+	if (!this->bContinuousPlacement || this->ContinuousScale < 0) {
+		return 30.0 / this->State.Dist;
+	}
+	/* Samples traced so far in this pass already reflect walls closing in */
+	return FMath::Min(this->ContinuousScale, this->ContinuousPassMin);
+}
+
+void UForcedPerspectiveComponent::ResetContinuousPlacement() {
+	this->ContinuousScale = -1;
+	this->ContinuousPassMin = std::numeric_limits<double>::max();
+	this->ContinuousCursor = 0;
+	this->ContinuousBinding = INDEX_NONE;
+	this->ContinuousPassBinding = INDEX_NONE;
+}
+
+void UForcedPerspectiveComponent::StepContinuousPlacement(FTransform const &View, double const &Far) {
+	FDirectionSamples const& Dirs = this->ComputeInput.Directions;
+	int32 const Num = Dirs.Num();
+	if (Num == 0) {
+		return;
+	}
+	FVector const CamLocation = View.GetLocation();
+	FQuat const CamRotation = View.GetRotation();
+	FCollisionQueryParams const& QueryParams = this->ComputeInput.QueryParams;
+	UWorld* const World = this->GetWorld();
+	auto TraceSample = [&](int32 i) {
+		++this->ComputeRays;
+		return PersianPlacement::TraceSampleScale(World, CamLocation, CamRotation.RotateVector(Dirs.GetUnit(i)),
+			Dirs.GetLength(i), Far, QueryParams);
+	};
+	double const Deadline = FPlatformTime::Seconds() + this->ContinuousSolveBudgetMs / 1000.0;
+
+	FPhysicsCommand::ExecuteRead(World->GetPhysicsScene(), [&]() {
+		/* Warm start: a new pass first traces the sample that bound the previous one */
+		if (this->ContinuousCursor == 0 && this->ContinuousBinding != INDEX_NONE && this->ContinuousBinding < Num) {
+			this->ContinuousPassMin = TraceSample(this->ContinuousBinding);
+			this->ContinuousPassBinding = this->ContinuousBinding;
+		}
+		do {
+			int32 const i = this->ContinuousCursor++;
+			double const scale = TraceSample(i);
+			if (scale < this->ContinuousPassMin) {
+				this->ContinuousPassMin = scale;
+				this->ContinuousPassBinding = i;
+			}
+			if (this->ContinuousCursor == Num) {
+				/* Pass complete, publish it and start over on the next frame */
+				this->ContinuousScale = this->ContinuousPassMin;
+				this->ContinuousBinding = this->ContinuousPassBinding;
+				this->ContinuousPassMin = std::numeric_limits<double>::max();
+				this->ContinuousPassBinding = INDEX_NONE;
+				this->ContinuousCursor = 0;
+				break;
+			}
+		} while (FPlatformTime::Seconds() < Deadline);
+	});
+}
+
+FTransform UForcedPerspectiveComponent::ComputeHeldTransform(double const &RelativeScale) const {
+	return this->ComputeHeldTransform(RelativeScale, this->GetViewTransform(), this->State);
+}
+
+FTransform UForcedPerspectiveComponent::ComputeHeldTransform(double const &RelativeScale, FTransform const &View,
+	FObjectState const &HeldState) const {
+	FQuat const CamRotation = View.GetRotation();
+	return FTransform(
+		CamRotation * HeldState.Relative.GetRotation(),
+		View.GetLocation() + CamRotation.RotateVector(HeldState.Relative.GetTranslation() * RelativeScale),
+		HeldState.Relative.GetScale3D() * RelativeScale
+	);
+}
+
+void UForcedPerspectiveComponent::ScaleAttachedObject(double const &RelativeScale) {
+	if (this->AttachedObject != nullptr) {
+		PERSIAN_SCOPED_TIMING(ScaleAttached);
+		FTransform const View = this->GetViewTransform();
+		/* Nothing to do when neither the view nor the scale moved */
+		if (this->bHeldTransformValid && this->LastHeldScale == RelativeScale
+			&& this->LastHeldCamTransform.Equals(View, 0)) {
+			return;
+		}
+		this->LastHeldCamTransform = View;
+		this->LastHeldScale = RelativeScale;
+		this->bHeldTransformValid = true;
+
+		/* Update object scale, position and orientation at once, without sweeping or encroachment checks */
+		this->AttachedObject->SetActorTransform(this->ComputeHeldTransform(RelativeScale, View, this->State),
+			false, nullptr, ETeleportType::TeleportPhysics);
+	}
+}
+
+void UForcedPerspectiveComponent::ResetPlacementQueryParams() {
+	this->PlacementQueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(PersianPlacement), true);
+	PersianCollision::AddIgnoredHierarchy(this->PlacementQueryParams, this->GetOwner());
+	PersianCollision::AddIgnoredHierarchy(this->PlacementQueryParams, this->AttachedObject);
+	/* Called on every grab and release, which is when the directions change as well */
+	this->bComputeInputStale = true;
+}
+
+double UForcedPerspectiveComponent::SolvePlacementScale(FDirectionSamples const &Dirs, double const &Far) const {
+	PERSIAN_SCOPED_TIMING(PlacementSolve);
+	/* Counted here, the workers below must not touch the stats */
+	INC_DWORD_STAT_BY(STAT_PersianPlacementRays, Dirs.Num());
+	CSV_CUSTOM_STAT(Persian, PlacementRays, Dirs.Num(), ECsvCustomStatOp::Accumulate);
+	FTransform const View = this->GetViewTransform();
+	FVector CamLocation = View.GetLocation();
+	FCollisionQueryParams const& QueryParams = this->PlacementQueryParams;
+	UWorld* const World = this->GetWorld();
+	TArray<FVector> WorldDirs;
+	PersianDirections::RotateToWorld(Dirs, View.GetRotation(), WorldDirs);
+
+	/* Static geometry through its BVH when there is one, the fallback gathered once for every chunk */
+	UPersianStaticScene const* const Scene = UPersianStaticScene::GetForQueries(World);
+	FStaticRayQuery Query;
+	if (Scene != nullptr) {
+		Scene->PrepareRays(Query, CamLocation, WorldDirs.GetData(), WorldDirs.Num(), float(Far), QueryParams);
+	}
+
+	/* Smallest scale allowed by Dirs[Begin, End) */
+	auto SolveRange = [&](int32 Begin, int32 End) {
+		double minScale = std::numeric_limits<double>::max();
+		if (Scene != nullptr) {
+			TArray<float, TInlineAllocator<256>> Distances;
+			Distances.SetNumUninitialized(End - Begin);
+			Scene->RayCast(Query, Begin, WorldDirs.GetData() + Begin, End - Begin, Distances.GetData());
+			for (int32 i = Begin; i < End; ++i) {
+				minScale = FMath::Min(minScale, PersianPlacement::HitScale(Distances[i - Begin], Dirs.GetLength(i), Far));
+			}
+			return minScale;
+		}
+		for (int32 i = Begin; i < End; ++i) {
+			minScale = FMath::Min(minScale, PersianPlacement::TraceSampleScale(World, CamLocation, WorldDirs[i], Dirs.GetLength(i), Far, QueryParams));
+		}
+		return minScale;
+	};
+
+	int32 const ChunkSize = PersianPlacement::GetRayChunkSize();
+	if (CVarParallelPlacement.GetValueOnAnyThread() == 0 || Dirs.Num() <= ChunkSize) {
+		return SolveRange(0, Dirs.Num());
+	}
+
+	/* Batched path: one minimum per chunk, reduced once every worker is done */
+	int32 const NumChunks = FMath::DivideAndRoundUp(Dirs.Num(), ChunkSize);
+	TArray<double> ChunkMin;
+	ChunkMin.SetNumUninitialized(NumChunks);
+	FPhysicsCommand::ExecuteRead(World->GetPhysicsScene(), [&]() {
+		ParallelFor(NumChunks, [&](int32 Chunk) {
+			ChunkMin[Chunk] = SolveRange(Chunk * ChunkSize, FMath::Min(Dirs.Num(), (Chunk + 1) * ChunkSize));
+		});
+	});
+	return FMath::Min(ChunkMin);
+}
+
+double UForcedPerspectiveComponent::SolveSweepScale(double const &Far) const {
+	FTransform const View = this->GetViewTransform();
+	FVector const CamLocation = View.GetLocation();
+	FQuat const CamRotation = View.GetRotation();
+	FQuat const ObjectRotation = CamRotation * this->State.Relative.GetRotation();
+	FVector const Scale = this->State.Relative.GetScale3D();
+	/* Everything scales about the camera: the box centre sits at CamLocation + CenterDir * s */
+	FVector const CenterDir = CamRotation.RotateVector(this->State.Relative.GetTranslation())
+		+ ObjectRotation.RotateVector(this->AttachedLocalBounds.GetCenter() * Scale);
+	FVector const Extent = this->AttachedLocalBounds.GetExtent() * Scale.GetAbs();
+	double const CenterDist = CenterDir.Size();
+	if (CenterDist < KINDA_SMALL_NUMBER) {
+		return 1;
+	}
+
+	FCollisionQueryParams const& QueryParams = this->PlacementQueryParams;
+	UWorld* const World = this->GetWorld();
+	INC_DWORD_STAT(STAT_PersianPlacementRays);
+
+	/* Upper bracket: the box centre cannot go past whatever is straight behind it */
+	double hi = Far / CenterDist;
+	FHitResult hitres;
+	if (World->LineTraceSingleByChannel(hitres, CamLocation, CamLocation + CenterDir / CenterDist * Far,
+			PersianCollision::GetQueryChannel(), QueryParams)) {
+		hi = FMath::Min<double>(hi, (hitres.Distance - 1) / CenterDist);
+	}
+	auto Fits = [&](double s) {
+		return !World->OverlapBlockingTestByChannel(CamLocation + CenterDir * s, ObjectRotation,
+			PersianCollision::GetQueryChannel(), FCollisionShape::MakeBox(Extent * s), QueryParams);
+	};
+	if (hi <= 0 || Fits(hi)) {
+		return FMath::Max<double>(hi, 0);
+	}
+
+	/* Largest non-penetrating scale in [0, hi], assuming the box fits when shrunk onto the camera */
+	double lo = 0;
+	double const Precision = FMath::Max(CVarSweepPrecision.GetValueOnAnyThread(), KINDA_SMALL_NUMBER);
+	for (int32 Iteration = 0; Iteration < 64 && hi - lo > Precision * hi; ++Iteration) {
+		double const mid = 0.5 * (lo + hi);
+		if (Fits(mid)) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+double UForcedPerspectiveComponent::SolveRasterScale(double const &Far) const {
+	PERSIAN_SCOPED_TIMING(PlacementSolve);
+	FTransform const View = this->GetViewTransform();
+	return PersianDepthRaster::SolveScale(this->GetWorld(), View.GetLocation(), View.GetRotation(),
+		this->Directions, Far, this->PlacementQueryParams);
+}
+
+EPlacementSolver UForcedPerspectiveComponent::GetPlacementSolver() const {
+	int32 const Override = CVarPlacementSolver.GetValueOnAnyThread();
+	if (Override >= 0 && Override <= int32(EPlacementSolver::DepthRaster)) {
+		return EPlacementSolver(Override);
+	}
+	return this->PlacementSolver;
+}
+
+void UForcedPerspectiveComponent::MoveAttachedObject(double const &Far) {
+	if (this->AttachedObject != nullptr) {
+		PERSIAN_SCOPED_TIMING(MoveAttached);
+		if (this->bContinuousPlacement && this->ContinuousScale >= 0) {
+			/* Already solved while holding */
+			this->ScaleAttachedObject(this->GetHeldScale());
+			return;
+		}
+		if (this->GetPlacementSolver() == EPlacementSolver::SweepBisect) {
+			this->ScaleAttachedObject(this->SolveSweepScale(Far));
+			return;
+		}
+		if (this->GetPlacementSolver() == EPlacementSolver::DepthRaster) {
+			this->ScaleAttachedObject(this->SolveRasterScale(Far));
+			return;
+		}
+		double minScale = this->SolvePlacementScale(this->Directions, Far);
+
+#if !UE_BUILD_SHIPPING
+		if (CVarValidateSampling.GetValueOnGameThread() != 0
+			&& this->FullDirections.Num() > this->Directions.Num()) {
+			double const fullScale = this->SolvePlacementScale(this->FullDirections, Far);
+			if (FMath::Abs(minScale - fullScale) > this->SampleTolerance * fullScale) {
+				UE_LOG(LogForcedPerspective, Warning,
+					TEXT("Sampled placement scale %f (%d samples) is off the full-vertex scale %f (%d vertices)"),
+					minScale, this->Directions.Num(), fullScale, this->FullDirections.Num());
+			}
+		}
+#endif
+
+		this->ScaleAttachedObject(minScale);
+	}
+}
+
+bool UForcedPerspectiveComponent::GrabObject(AActor* Object, FVector const &HitLocation) {
+	if (Object == nullptr || !this->Attach(Object, HitLocation)) {
+		return false;
+	}
+	this->AttachedObject->SetActorEnableCollision(false);
+	this->ScaleAttachedObject(30.0 / this->State.Dist);
+	return true;
+}
+
+bool UForcedPerspectiveComponent::GrabInstance(UInstancedStaticMeshComponent* Instances, int32 Item, FVector const &HitLocation) {
+	if (this->AttachedObject != nullptr) {
+		return false;
+	}
+	APersianInstanceProxy* Proxy = APersianInstanceProxy::Promote(Instances, Item, this, HitLocation);
+	if (Proxy == nullptr) {
+		return false;
+	}
+	if (!this->GrabObject(Proxy, HitLocation)) {
+		/* Hands back to the instance right away */
+		Proxy->Destroy();
+		return false;
+	}
+	return true;
+}
+
+void UForcedPerspectiveComponent::ReleaseAttachedObject(double const &Far) {
+	if (this->AttachedObject == nullptr || this->bReleasePending) {
+		return;
+	}
+	UPersianPlacementSubsystem* Placement = this->GetWorld()->GetSubsystem<UPersianPlacementSubsystem>();
+	bool const bSolvedAlready = this->bContinuousPlacement && this->ContinuousScale >= 0;
+	if (Placement != nullptr && CVarBatchPlacement.GetValueOnGameThread() != 0 && !bSolvedAlready
+		&& this->GetPlacementSolver() == EPlacementSolver::Rays && CVarValidateSampling.GetValueOnGameThread() == 0) {
+		/* Solved along with every other holder's after the camera update, the object follows the view until then */
+		this->bReleasePending = true;
+		Placement->RequestPlacement(this, Far, [this](double Scale) {
+			/* Placed and let go of by the apply phase, the only one to change the held state mid-frame */
+			this->ReleaseScale = Scale;
+			this->bReleaseSolved = true;
+		});
+		return;
+	}
+	this->MoveAttachedObject(Far);
+	this->FinishRelease();
+}
+
+void UForcedPerspectiveComponent::FinishRelease() {
+	if (this->AttachedObject != nullptr) {
+		AActor* const Released = this->AttachedObject;
+		Released->SetActorEnableCollision(true);
+		this->Detach();
+		if (APersianInstanceProxy* Proxy = Cast<APersianInstanceProxy>(Released)) {
+			/* Back to an instance once it lies still */
+			Proxy->Settle();
+		}
+	}
+}
+
+bool UForcedPerspectiveComponent::Attach(AActor* Object, FVector const &HitLocation) {
+	if (Object == nullptr || Object->GetRootComponent()->Mobility == EComponentMobility::Static) {
+		return false;
+	}
+	PERSIAN_SCOPED_TIMING(Attach);
+	/* Rejects what has no samples before touching the object */
+	UPersianAttachableRegistry* Registry = this->GetWorld()->GetSubsystem<UPersianAttachableRegistry>();
+	FAttachableInfo const* Info = Registry != nullptr ? &Registry->FindOrRegister(Object, this->PlacementGeometry) : nullptr;
+	if (Info != nullptr && !Info->bAttachable) {
+		return false;
+	}
+	this->AttachedLocalBounds = Info != nullptr ? Info->LocalBounds : Object->CalculateComponentsBoundingBoxInLocalSpace(false);
+	this->AttachedObject = Object;
+	this->ResetPlacementQueryParams();
+	/* Disable physics simulation */
+	this->AttachedObject->DisableComponentsSimulatePhysics();
+	FVector centroid, _;
+	this->AttachedObject->GetActorBounds(true, centroid, _);
+	this->ResetContinuousPlacement();
+	FTransform const View = this->GetViewTransform();
+	FVector CamLocation = View.GetLocation();
+	FQuat CamRotation = View.GetRotation();
+	double const dist = (HitLocation - CamLocation).Size();
+	FQuat const InvCamRotation = CamRotation.Inverse();
+	this->State = FObjectState{
+		dist,
+		/* Object pose in view space, its location being the bounds centre pulled by the grab offset */
+		FTransform(
+			InvCamRotation * this->AttachedObject->GetActorQuat(),
+			FVector(dist, 0, 0) - InvCamRotation.RotateVector(HitLocation - centroid),
+			this->AttachedObject->GetActorScale3D()
+		),
+		this->AttachedObject->GetRootComponent()->Mobility,
+	};
+	this->bHeldTransformValid = false;
+	/* Enable movement */
+	this->AttachedObject->GetRootComponent()->SetMobility(EComponentMobility::Movable);
+	TArray<UStaticMeshComponent *> meshes;
+	this->AttachedObject->GetComponents<UStaticMeshComponent>(meshes, true);
+	{
+		/* Mesh samples to view space, the part that scales with the mesh */
+		PERSIAN_SCOPED_TIMING(AttachExtract);
+		for (auto meshcomp : meshes) {
+			auto mesh = meshcomp->GetStaticMesh();
+			/* Baked or cached mesh-space samples, the vertex buffers are not touched here */
+			TArray<FVector> const* points = PersianSampleCache::FindOrBuild(mesh, this->PlacementGeometry);
+			if (points == nullptr) {
+				continue;
+			}
+			INC_DWORD_STAT_BY(STAT_PersianAttachPoints, points->Num());
+			/* One mesh-to-view transform per component, applied in bulk */
+			FMatrix const ToCamera = PersianDirections::MakeToCameraMatrix(
+				meshcomp->GetComponentTransform(), CamLocation, CamRotation);
+			PersianDirections::AppendTransformed(this->Directions, points->GetData(), points->Num(), ToCamera);
+#if !UE_BUILD_SHIPPING
+			if (CVarValidateSampling.GetValueOnGameThread() != 0) {
+				TArray<FVector> full;
+				PersianSampleCache::BuildSamples(mesh, this->PlacementGeometry, 0, full);
+				PersianDirections::AppendTransformed(this->FullDirections, full.GetData(), full.Num(), ToCamera);
+			}
+#endif
+		}
+	}
+	/* Only keep the samples that matter for the placement solve */
+	PersianSampling::ReduceDirections(this->Directions, this->SampleBudget);
+	SET_DWORD_STAT(STAT_PersianHeldSamples, this->Directions.Num());
+	if (PersianDebug::ShowMessages()) {
+		GEngine->AddOnScreenDebugMessage(-1, 5, FColor::Yellow,
+			FString::Printf(TEXT("%d directions"), this->Directions.Num()));
+	}
+	/* Do not attach an object with no body */
+	if (this->Directions.Num() == 0) {
+		this->Detach();
+		return false;
+	}
+	this->SetHeldTickEnabled(true);
+	this->PublishHeldState();
+	return true;
+}
+
+void UForcedPerspectiveComponent::Detach() {
+	if (this->AttachedObject == nullptr) {
+		return;
+	}
+	AActor* const Released = this->AttachedObject;
+	/* Re-enable physics simulation */
+	Cast<UPrimitiveComponent>(this->AttachedObject->GetRootComponent())->SetSimulatePhysics(true);
+	/* Disable movement */
+	this->AttachedObject->GetRootComponent()->SetMobility(this->State.Mobility);
+	if (this->GetOwner()->HasAuthority() && this->bHeldReplicatedMovement) {
+		/* Clients get the final pose and the fall from the object again */
+		this->AttachedObject->SetReplicateMovement(true);
+	}
+	this->bHeldReplicatedMovement = false;
+	this->AttachedObject = nullptr;
+	this->SetHeldTickEnabled(false);
+	this->bReleaseSolved = false;
+	if (this->bReleasePending) {
+		this->bReleasePending = false;
+		if (UPersianPlacementSubsystem* Placement = this->GetWorld()->GetSubsystem<UPersianPlacementSubsystem>()) {
+			Placement->CancelPlacement(this);
+		}
+	}
+	this->State = FObjectState {
+		std::numeric_limits<double>::lowest(),
+		FTransform::Identity,
+		EComponentMobility::Movable,
+	};
+	/* Keep the allocation for the next grab */
+	this->Directions.Reset();
+	SET_DWORD_STAT(STAT_PersianHeldSamples, 0);
+	this->AttachedLocalBounds = FBox(ForceInit);
+	this->ResetContinuousPlacement();
+	this->ResetPlacementQueryParams();
+#if !UE_BUILD_SHIPPING
+	this->FullDirections.Empty();
+#endif
+	this->PublishHeldState(Released);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Replication
+
+void UForcedPerspectiveComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const {
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	/* The owner predicts its own hold */
+	DOREPLIFETIME_CONDITION(UForcedPerspectiveComponent, HeldState, COND_SkipOwner);
+	DOREPLIFETIME_CONDITION(UForcedPerspectiveComponent, ReplicatedHeldScale, COND_SkipOwner);
+}
+
+bool UForcedPerspectiveComponent::ChargeNetBytes(int32 Bytes, bool bForce) {
+	double const Now = this->GetWorld()->GetTimeSeconds();
+	if (Now - this->NetWindowStart >= 1) {
+		this->HeldNetBytesPerSecond = this->NetWindowBytes / FMath::Max(1.0, Now - this->NetWindowStart);
+		this->NetWindowStart = Now;
+		this->NetWindowBytes = 0;
+	}
+	int32 const Budget = CVarNetBudget.GetValueOnGameThread();
+	if (!bForce && Budget > 0 && this->NetWindowBytes + Bytes > Budget) {
+		return false;
+	}
+	this->NetWindowBytes += Bytes;
+	return true;
+}
+
+UPackageMap const* UForcedPerspectiveComponent::GetClientPackageMap() const {
+	UNetDriver const* Driver = this->GetWorld()->GetNetDriver();
+	/* NetGUIDs are shared between the connections of a driver, any one measures for all */
+	return Driver != nullptr && Driver->ClientConnections.Num() > 0 ? Driver->ClientConnections[0]->PackageMap : nullptr;
+}
+
+void UForcedPerspectiveComponent::PublishHeldState(AActor* Released) {
+	if (!this->GetOwner()->HasAuthority()) {
+		return;
+	}
+	if (this->AttachedObject != nullptr) {
+		/* Every client places the object from the holder's view, its movement need not be sent while held */
+		this->bHeldReplicatedMovement = this->AttachedObject->IsReplicatingMovement();
+		this->AttachedObject->SetReplicateMovement(false);
+		this->HeldState.Object = this->AttachedObject;
+		this->HeldState.Rotation = this->State.Relative.Rotator();
+		this->HeldState.Offset = this->State.Relative.GetTranslation();
+		this->HeldState.Scale3D = this->State.Relative.GetScale3D();
+		this->HeldState.Dist = this->State.Dist;
+		this->ReplicatedHeldScale = PersianNet::QuantizeScale(30.0 / this->State.Dist);
+	} else if (Released != nullptr) {
+		/* The clients get its location and rotation back from its movement, but not the scale it was placed at */
+		this->HeldState = FReplicatedHeldState();
+		this->HeldState.Object = Released;
+		this->HeldState.bReleased = true;
+		this->HeldState.Rotation = Released->GetActorRotation();
+		this->HeldState.Offset = Released->GetActorLocation();
+		this->HeldState.Scale3D = Released->GetActorScale3D();
+	} else {
+		this->HeldState = FReplicatedHeldState();
+	}
+	UPackageMap const* Map = this->GetClientPackageMap();
+	this->ChargeNetBytes(Map != nullptr ? this->HeldState.MeasureNetBytes(Map) : 0, true);
+}
+
+void UForcedPerspectiveComponent::PublishHeldScale(double const &RelativeScale) {
+	uint16 const Quantized = PersianNet::QuantizeScale(RelativeScale);
+	int32 const Bytes = this->GetClientPackageMap() != nullptr ? sizeof(Quantized) : 0;
+	if (Quantized != this->ReplicatedHeldScale && this->ChargeNetBytes(Bytes, false)) {
+		this->ReplicatedHeldScale = Quantized;
+	}
+}
+
+void UForcedPerspectiveComponent::OnRep_HeldState() {
+	AActor* const Object = this->HeldState.Object;
+	if (this->HeldState.bReleased) {
+		if (Object != nullptr && Object == this->AttachedObject) {
+			Object->SetActorTransform(FTransform(this->HeldState.Rotation, this->HeldState.Offset, this->HeldState.Scale3D),
+				false, nullptr, ETeleportType::TeleportPhysics);
+		} else if (Object != nullptr) {
+			/* Joined after the grab: the rest of the pose is the object's own movement to replicate */
+			Object->SetActorScale3D(this->HeldState.Scale3D);
+		}
+		if (this->AttachedObject != nullptr) {
+			this->AttachedObject->SetActorEnableCollision(true);
+			this->Detach();
+		}
+		return;
+	}
+	if (this->AttachedObject != nullptr && this->AttachedObject != Object) {
+		this->AttachedObject->SetActorEnableCollision(true);
+		this->Detach();
+	}
+	if (Object == nullptr) {
+		return;
+	}
+	if (this->AttachedObject == nullptr) {
+		/* Placement only: holders on other clients never solve, so no samples are taken */
+		this->AttachedObject = Object;
+		Object->DisableComponentsSimulatePhysics();
+		this->State.Mobility = Object->GetRootComponent()->Mobility;
+		Object->GetRootComponent()->SetMobility(EComponentMobility::Movable);
+		Object->SetActorEnableCollision(false);
+		this->SetHeldTickEnabled(true);
+	}
+	this->State.Dist = this->HeldState.Dist;
+	this->State.Relative = FTransform(this->HeldState.Rotation, this->HeldState.Offset, this->HeldState.Scale3D);
+	this->bHeldTransformValid = false;
+}
+
+void UForcedPerspectiveComponent::ServerAttach_Implementation(AActor* Object, FVector_NetQuantize HitLocation) {
+	/* Only grab what the holder can reach, with some slack for the latency */
+	bool const bInReach = FVector::Dist(this->GetViewTransform().GetLocation(), HitLocation) <= 1500 + 200;
+	if (this->AttachedObject != nullptr || !bInReach || !this->GrabObject(Object, HitLocation)) {
+		this->ClientRejectAttach();
+	}
+}
+
+void UForcedPerspectiveComponent::ServerAttachInstance_Implementation(UInstancedStaticMeshComponent* Instances, int32 Item,
+	FVector_NetQuantize HitLocation) {
+	if (FVector::Dist(this->GetViewTransform().GetLocation(), HitLocation) <= 1500 + 200) {
+		this->GrabInstance(Instances, Item, HitLocation);
+	}
+}
+
+void UForcedPerspectiveComponent::ServerRelease_Implementation() {
+	this->ReleaseAttachedObject();
+}
+
+void UForcedPerspectiveComponent::ClientRejectAttach_Implementation() {
+	if (this->AttachedObject != nullptr) {
+		this->AttachedObject->SetActorEnableCollision(true);
+		this->Detach();
+	}
+}
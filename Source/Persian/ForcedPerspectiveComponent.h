@@ -0,0 +1,300 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CollisionQueryParams.h"
+#include "Components/ActorComponent.h"
+#include "Engine/EngineBaseTypes.h"
+#include "PersianDirections.h"
+#include "PersianReplication.h"
+#include "PersianSampleData.h"
+#include "ForcedPerspectiveComponent.generated.h"
+
+class UForcedPerspectiveComponent;
+class UInstancedStaticMeshComponent;
+class USceneComponent;
+
+/** How MoveAttachedObject finds the largest placement scale on release */
+UENUM(BlueprintType)
+enum class EPlacementSolver : uint8 {
+	/** One ray per direction sample */
+	Rays,
+	/** Bisection on scale against the simple collision box of the held object */
+	SweepBisect,
+	/** Direction samples looked up in a CPU depth raster of the simple collision they look at */
+	DepthRaster,
+};
+
+USTRUCT()
+struct FObjectState {
+	GENERATED_USTRUCT_BODY()
+
+	FObjectState();
+	FObjectState(double const& dist, FTransform const& relative,
+		EComponentMobility::Type const &mobility);
+
+	double Dist;
+	/* Transform of the object relative to the view at grab time, before any relative scaling */
+	FTransform Relative;
+	EComponentMobility::Type Mobility;
+};
+
+/**
+ * Game-thread start of the held object update: snapshots the view and the
+ * held state for the component tick.  Only enabled while holding.
+ */
+USTRUCT()
+struct FHeldObjectPrepareTickFunction : public FTickFunction {
+	GENERATED_USTRUCT_BODY()
+
+	UForcedPerspectiveComponent* Target;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread,
+		const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FHeldObjectPrepareTickFunction> : public TStructOpsTypeTraitsBase2<FHeldObjectPrepareTickFunction> {
+	enum {
+		WithCopy = false
+	};
+};
+
+/**
+ * Game-thread end of the held object update: writes the transform computed
+ * by the component tick.  Only enabled while holding.
+ */
+USTRUCT()
+struct FHeldObjectApplyTickFunction : public FTickFunction {
+	GENERATED_USTRUCT_BODY()
+
+	UForcedPerspectiveComponent* Target;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread,
+		const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FHeldObjectApplyTickFunction> : public TStructOpsTypeTraitsBase2<FHeldObjectApplyTickFunction> {
+	enum {
+		WithCopy = false
+	};
+};
+
+/**
+ * Lets any actor hold an object in front of its view, forced-perspective
+ * style: the object keeps its apparent size while it follows the view, and
+ * is scaled to the largest size that fits the scene when released.
+ *
+ * Each frame, once the view is final, runs in three phases:
+ *  - FHeldObjectPrepareTickFunction snapshots the view, the held state and
+ *    the query parameters on the game thread, along with the Blueprint tick
+ *    of the component and the sweep or raster continuous solves;
+ *  - the component tick computes where the held object goes from that
+ *    snapshot, continuous placement rays included, on a worker thread;
+ *  - FHeldObjectApplyTickFunction then writes that transform, and the
+ *    replicated scale, on the game thread.
+ * Batched release solves are flushed before the phases start, and leave
+ * placing and letting go of the object to the apply phase.
+ * The grab state replicates to the other clients from the server, the owning
+ * client predicts its own.
+ */
+UCLASS(ClassGroup = Persian, meta = (BlueprintSpawnableComponent))
+class PERSIAN_API UForcedPerspectiveComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UForcedPerspectiveComponent();
+
+	/** What the object is held in front of, the owner's first camera when unset */
+	UPROPERTY(BlueprintReadWrite, Category = "Persian")
+	USceneComponent* ViewComponent;
+
+	/** Source of the points the placement solve works on */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Persian")
+	EPlacementGeometry PlacementGeometry;
+
+	/** Maximum number of direction samples kept for the placement solve, 0 keeps every vertex */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Persian")
+	int32 SampleBudget;
+
+	/** Accepted relative error of the sampled placement scale against the full-vertex one (see persian.ValidateSampling) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Persian")
+	float SampleTolerance;
+
+	/** Placement solver used on release, unless overridden by persian.PlacementSolver */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Persian")
+	EPlacementSolver PlacementSolver;
+
+	/** Keep solving the placement while holding, so the held object scales against the scene */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Persian")
+	uint8 bContinuousPlacement : 1;
+
+	/** Time the continuous placement solve may spend per frame, in milliseconds */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Persian", meta = (EditCondition = "bContinuousPlacement"))
+	float ContinuousSolveBudgetMs;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Persian")
+	AActor* AttachedObject;
+
+	UFUNCTION(BlueprintCallable, Category = "Persian")
+	bool Attach(AActor* Object, FVector const &HitLocation);
+	UFUNCTION(BlueprintCallable, Category = "Persian")
+	void Detach();
+	UFUNCTION(BlueprintCallable, Category = "Persian")
+	AActor* Attaching() const { return this->AttachedObject; }
+
+	/** Attach and show the object at its grab-time size, as on a click */
+	bool GrabObject(AActor* Object, FVector const &HitLocation);
+	/** Server: promotes instance Item of Instances to a proxy actor and grabs that */
+	bool GrabInstance(UInstancedStaticMeshComponent* Instances, int32 Item, FVector const &HitLocation);
+	/** Places the held object and lets go of it, through the batched placement subsystem when possible */
+	void ReleaseAttachedObject(double const &Far = 50000);
+	/** Whether a release solve is queued to the placement subsystem */
+	bool IsReleasePending() const { return this->bReleasePending; }
+
+	/** Where the object is held from: the view component, or the replicated aim of pawns controlled elsewhere */
+	FTransform GetViewTransform() const;
+	void ScaleAttachedObject(double const &RelativeScale);
+	void MoveAttachedObject(double const &Far = 50000);
+	/** Query parameters of the placement traces, ignoring the owner and the held object along with what is attached to them */
+	FCollisionQueryParams const& GetPlacementQueryParams() const { return this->PlacementQueryParams; }
+	/** Scale the held object is shown at, solved against the scene in continuous mode */
+	double GetHeldScale() const;
+	/** World transform of the attached object at RelativeScale, for the current view */
+	FTransform ComputeHeldTransform(double const &RelativeScale) const;
+	/** Forces the next ScaleAttachedObject to move the object even if the view did not move */
+	void InvalidateHeldTransform() { this->bHeldTransformValid = false; }
+
+	/** Solver picked by persian.PlacementSolver, or PlacementSolver when it is not set */
+	EPlacementSolver GetPlacementSolver() const;
+	/** Largest scale at which every direction still fits in front of the scene */
+	double SolvePlacementScale(FDirectionSamples const &Dirs, double const &Far) const;
+	/** Largest scale at which the bounding box of the attached object does not penetrate the scene */
+	double SolveSweepScale(double const &Far) const;
+	/** Largest scale at which every direction fits in front of the depth raster of the scene, see PersianDepthRaster */
+	double SolveRasterScale(double const &Far) const;
+	/** Direction samples of the attached object, in view space at grab time */
+	FDirectionSamples const& GetDirections() const { return this->Directions; }
+
+	/** Replication cost of the grab state of this holder over the last second, per client, as serialized without property headers */
+	float GetHeldNetBytesPerSecond() const { return this->HeldNetBytesPerSecond; }
+
+	UFUNCTION(Server, Reliable)
+	void ServerAttach(AActor* Object, FVector_NetQuantize HitLocation);
+	UFUNCTION(Server, Reliable)
+	void ServerAttachInstance(UInstancedStaticMeshComponent* Instances, int32 Item, FVector_NetQuantize HitLocation);
+	UFUNCTION(Server, Reliable)
+	void ServerRelease();
+
+	/** Prepare phase, see the class comment */
+	void PrepareHeldObject(float DeltaTime, ELevelTick TickType);
+	/** Compute phase, see the class comment */
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	/** Apply phase, see the class comment */
+	void ApplyHeldObject();
+
+	virtual void OnRegister() override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+protected:
+	virtual void RegisterComponentTickFunctions(bool bRegister) override;
+
+private:
+	FHeldObjectPrepareTickFunction PrepareTick;
+	FHeldObjectApplyTickFunction ApplyTick;
+
+	FObjectState State;
+	FDirectionSamples Directions;
+#if !UE_BUILD_SHIPPING
+	/* Unreduced directions, only kept while validating the sampling stage */
+	FDirectionSamples FullDirections;
+#endif
+	/* Bounds of the attached object in its own unscaled space */
+	FBox AttachedLocalBounds;
+	/* Built on grab, so that the actor hierarchies are walked once rather than on every solve */
+	FCollisionQueryParams PlacementQueryParams;
+	void ResetPlacementQueryParams();
+
+	/* Everything the compute phase reads of the component, written by the prepare phase */
+	struct FHeldComputeInput
+	{
+		bool bActive = false;
+		FTransform View;
+		FObjectState State;
+		/* Scale to show the object at, negative for the compute phase to step the continuous ray solve */
+		double Scale = 0;
+		/* Copied again only after a grab or release, see bComputeInputStale */
+		FDirectionSamples Directions;
+		FCollisionQueryParams QueryParams;
+	};
+	FHeldComputeInput ComputeInput;
+	/* The directions or query parameters changed since the prepare phase last copied them */
+	bool bComputeInputStale;
+	/* Placement rays traced by the compute phase, added to the stats by the apply phase */
+	int32 ComputeRays;
+
+	/* Time-sliced placement solve: scale of the last complete pass (negative if none yet),
+	 * minimum and binding sample of the pass in progress, and the next sample to trace */
+	double ContinuousScale;
+	double ContinuousPassMin;
+	int32 ContinuousCursor;
+	int32 ContinuousBinding;
+	int32 ContinuousPassBinding;
+	void ResetContinuousPlacement();
+	/* Traces as many samples of the compute input as fit in ContinuousSolveBudgetMs.  Compute phase */
+	void StepContinuousPlacement(FTransform const &View, double const &Far = 50000);
+
+	/* A release solve is queued to the placement subsystem */
+	bool bReleasePending;
+	/* The queued release solve came back with ReleaseScale, for ApplyHeldObject to place and let go of the object */
+	bool bReleaseSolved;
+	double ReleaseScale;
+	/* Drops the held object where it was last placed */
+	void FinishRelease();
+	/* Enables or disables both update phases */
+	void SetHeldTickEnabled(bool bEnabled);
+
+	/* View pose and scale the held object was last placed for */
+	FTransform LastHeldCamTransform;
+	double LastHeldScale;
+	bool bHeldTransformValid;
+	/* Written by the compute phase for the apply phase */
+	FTransform PendingHeldTransform;
+	FTransform PendingHeldView;
+	double PendingHeldScale;
+	bool bHeldApplyPending;
+
+	FTransform ComputeHeldTransform(double const &RelativeScale, FTransform const &View, FObjectState const &HeldState) const;
+
+	/* Grab state for the other clients, the owner predicts its own */
+	UPROPERTY(ReplicatedUsing = OnRep_HeldState)
+	FReplicatedHeldState HeldState;
+	/* Relative scale of the held object, quantized by PersianNet::QuantizeScale */
+	UPROPERTY(Replicated)
+	uint16 ReplicatedHeldScale;
+	UFUNCTION()
+	void OnRep_HeldState();
+	/* Whether the held object replicated its movement before being grabbed */
+	bool bHeldReplicatedMovement;
+
+	/* Bytes charged to the replication budget of this holder, in the current one-second window, as serialized */
+	double NetWindowStart;
+	int32 NetWindowBytes;
+	float HeldNetBytesPerSecond;
+	/* Charges Bytes to the budget, returns false when they do not fit unless bForce */
+	bool ChargeNetBytes(int32 Bytes, bool bForce);
+	/* Package map of a client connection, to measure what is sent with; null without any client */
+	UPackageMap const* GetClientPackageMap() const;
+	/* Server: sends the grab state of the held object, or the final pose of Released once let go of */
+	void PublishHeldState(AActor* Released = nullptr);
+	/* Server: sends RelativeScale when the budget allows */
+	void PublishHeldScale(double const &RelativeScale);
+
+	UFUNCTION(Client, Reliable)
+	void ClientRejectAttach();
+};
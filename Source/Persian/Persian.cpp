@@ -1,7 +1,61 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "Persian.h"
+#include "Engine/Engine.h"
+#include "HAL/IConsoleManager.h"
 #include "Modules/ModuleManager.h"
 
+DEFINE_LOG_CATEGORY(LogPersianStartup);
+
+CSV_DEFINE_CATEGORY_MODULE(PERSIAN_API, Persian, true);
+
+static TAutoConsoleVariable<int32> CVarDebugMessages(
+	TEXT("persian.DebugMessages"),
+	0,
+	TEXT("Print grab and release details on screen."),
+	ECVF_Default);
+
+bool PersianDebug::ShowMessages() {
+	return GEngine != nullptr && CVarDebugMessages.GetValueOnGameThread() != 0;
+}
+
+static TAutoConsoleVariable<int32> CVarStartupSyncLoad(
+	TEXT("persian.Startup.SyncLoad"),
+	0,
+	TEXT("Load the pawn blueprint in InitGame and the HUD textures in BeginPlay synchronously, as the\n")
+	TEXT("constructor finders used to, to compare cold starts with. Read once at startup: set it from the\n")
+	TEXT("command line with -ini:Engine:[ConsoleVariables]:persian.Startup.SyncLoad=1."),
+	ECVF_Default);
+
+namespace PersianStartup
+{
+
+static TArray<FMark> Marks;
+static double Blocked = 0;
+
+bool SyncLoad() {
+	return CVarStartupSyncLoad.GetValueOnGameThread() != 0;
+}
+
+void Mark(TCHAR const* Name) {
+	FMark& Added = Marks.AddDefaulted_GetRef();
+	Added.Name = Name;
+	Added.Seconds = FPlatformTime::Seconds() - GStartTime;
+	UE_LOG(LogPersianStartup, Log, TEXT("%s at %.3f s"), Name, Added.Seconds);
+}
+
+void AddBlocked(double Seconds) {
+	Blocked += Seconds;
+}
+
+TArray<FMark> const& GetMarks() {
+	return Marks;
+}
+
+double GetBlocked() {
+	return Blocked;
+}
+
+}
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, Persian, "Persian" );
- 
\ No newline at end of file
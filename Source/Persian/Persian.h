@@ -3,3 +3,59 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+/** Load and startup timings */
+PERSIAN_API DECLARE_LOG_CATEGORY_EXTERN(LogPersianStartup, Log, All);
+
+/** Grab and release timings, see "stat Persian" */
+DECLARE_STATS_GROUP(TEXT("Persian"), STATGROUP_Persian, STATCAT_Advanced);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(PERSIAN_API, Persian);
+
+namespace PersianDebug
+{
+	/**
+	 * Whether to print grab and release details on screen, see
+	 * persian.DebugMessages.  On-screen messages format strings every call,
+	 * only pay for them when asked to.  Game thread
+	 */
+	PERSIAN_API bool ShowMessages();
+}
+
+/** Cold-start milestones of this process, see persian.Bench.Startup */
+namespace PersianStartup
+{
+	struct FMark
+	{
+		FString Name;
+		/** Since GStartTime */
+		double Seconds;
+	};
+
+	/**
+	 * Whether the game mode and HUD load their assets synchronously, the way
+	 * their constructor finders did, to measure against.  See
+	 * persian.Startup.SyncLoad
+	 */
+	PERSIAN_API bool SyncLoad();
+
+	/** Logs Name with the time since GStartTime and keeps it for the report.  Game thread */
+	PERSIAN_API void Mark(TCHAR const* Name);
+	/** Adds to the time the game thread spent waiting for asset loads.  Game thread */
+	PERSIAN_API void AddBlocked(double Seconds);
+
+	PERSIAN_API TArray<FMark> const& GetMarks();
+	PERSIAN_API double GetBlocked();
+}
+
+/**
+ * Times the enclosing scope under the STAT_Persian<Name> cycle stat, an
+ * Insights CPU event and the Persian CSV category at once.
+ */
+#define PERSIAN_SCOPED_TIMING(Name) \
+	SCOPE_CYCLE_COUNTER(STAT_Persian##Name); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(Persian_##Name); \
+	CSV_SCOPED_TIMING_STAT(Persian, Name)
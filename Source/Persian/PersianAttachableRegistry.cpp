@@ -0,0 +1,133 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianAttachableRegistry.h"
+#include "Persian.h"
+#include "ForcedPerspectiveComponent.h"
+#include "PersianCollision.h"
+#include "PersianInstanceProxy.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Attachable registration"), STAT_PersianRegisterAttachable, STATGROUP_Persian);
+DECLARE_CYCLE_STAT(TEXT("Hover query"), STAT_PersianHover, STATGROUP_Persian);
+
+void UPersianAttachableRegistry::Initialize(FSubsystemCollectionBase& Collection) {
+	Super::Initialize(Collection);
+	this->ActorSpawnedHandle = this->GetWorld()->AddOnActorSpawnedHandler(
+		FOnActorSpawned::FDelegate::CreateUObject(this, &UPersianAttachableRegistry::OnActorSpawned));
+	this->LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UPersianAttachableRegistry::OnLevelAdded);
+}
+
+void UPersianAttachableRegistry::Deinitialize() {
+	this->GetWorld()->RemoveOnActorSpawnedHandler(this->ActorSpawnedHandle);
+	FWorldDelegates::LevelAddedToWorld.Remove(this->LevelAddedHandle);
+	this->Infos.Empty();
+	this->Hovers.Empty();
+	Super::Deinitialize();
+}
+
+void UPersianAttachableRegistry::OnWorldBeginPlay(UWorld& InWorld) {
+	Super::OnWorldBeginPlay(InWorld);
+	for (ULevel* Level : InWorld.GetLevels()) {
+		this->OnLevelAdded(Level, &InWorld);
+	}
+}
+
+void UPersianAttachableRegistry::OnLevelAdded(ULevel* Level, UWorld* World) {
+	if (World != this->GetWorld() || Level == nullptr) {
+		return;
+	}
+	for (AActor* Actor : Level->Actors) {
+		PersianCollision::ApplyActorTags(Actor);
+	}
+}
+
+void UPersianAttachableRegistry::OnActorSpawned(AActor* Actor) {
+	/* Registered on first hover or grab only: building samples here would hitch every spawn of a static mesh */
+	PersianCollision::ApplyActorTags(Actor);
+}
+
+void UPersianAttachableRegistry::OnActorDestroyed(AActor* Actor) {
+	this->Infos.Remove(Actor);
+}
+
+void UPersianAttachableRegistry::OnViewerDestroyed(AActor* Actor) {
+	for (auto It = this->Hovers.CreateIterator(); It; ++It) {
+		UForcedPerspectiveComponent const* Viewer = It.Key().Get();
+		if (Viewer == nullptr || Viewer->GetOwner() == Actor) {
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void UPersianAttachableRegistry::Unregister(AActor* Actor) {
+	this->Infos.Remove(Actor);
+}
+
+FAttachableInfo const& UPersianAttachableRegistry::FindOrRegister(AActor* Actor, EPlacementGeometry Geometry) {
+	static FAttachableInfo const NotAttachable;
+	if (Actor == nullptr || Actor->GetRootComponent() == nullptr) {
+		return NotAttachable;
+	}
+	FAttachableInfo* Info = this->Infos.Find(Actor);
+	if (Info != nullptr && Info->Geometry == Geometry) {
+		return *Info;
+	}
+	SCOPE_CYCLE_COUNTER(STAT_PersianRegisterAttachable);
+	if (Info == nullptr) {
+		Info = &this->Infos.Add(Actor);
+		Actor->OnDestroyed.AddUniqueDynamic(this, &UPersianAttachableRegistry::OnActorDestroyed);
+	}
+	Info->Geometry = Geometry;
+	Info->NumSamples = 0;
+	if (Actor->GetRootComponent()->Mobility != EComponentMobility::Static) {
+		TArray<UStaticMeshComponent*> meshes;
+		Actor->GetComponents<UStaticMeshComponent>(meshes, true);
+		for (UStaticMeshComponent const* meshcomp : meshes) {
+			/* Builds the samples ahead of the grab as a side effect */
+			if (TArray<FVector> const* points = PersianSampleCache::FindOrBuild(meshcomp->GetStaticMesh(), Geometry)) {
+				Info->NumSamples += points->Num();
+			}
+		}
+	}
+	Info->bAttachable = Info->NumSamples > 0;
+	Info->LocalBounds = Info->bAttachable ? Actor->CalculateComponentsBoundingBoxInLocalSpace(false) : FBox(ForceInit);
+	return *Info;
+}
+
+FHoverResult const& UPersianAttachableRegistry::GetHover(UForcedPerspectiveComponent const* Viewer, double Far) {
+	FHoverResult* Found = this->Hovers.Find(Viewer);
+	if (Found == nullptr && Viewer != nullptr && Viewer->GetOwner() != nullptr) {
+		/* First query of this viewer, its entry goes along with it */
+		Viewer->GetOwner()->OnDestroyed.AddUniqueDynamic(this, &UPersianAttachableRegistry::OnViewerDestroyed);
+	}
+	FHoverResult& Hover = Found != nullptr ? *Found : this->Hovers.Add(Viewer);
+	if (Hover.Frame == GFrameCounter) {
+		return Hover;
+	}
+	SCOPE_CYCLE_COUNTER(STAT_PersianHover);
+	Hover.Frame = GFrameCounter;
+	Hover.Actor = nullptr;
+	Hover.bAttachable = false;
+	if (Viewer == nullptr) {
+		return Hover;
+	}
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(PersianHover), false, Viewer->GetOwner());
+	PersianCollision::AddIgnoredHierarchy(QueryParams, Viewer->Attaching());
+	FTransform const View = Viewer->GetViewTransform();
+	FVector const Start = View.GetLocation();
+	FHitResult hitres;
+	if (this->GetWorld()->LineTraceSingleByChannel(hitres, Start, Start + View.GetUnitAxis(EAxis::X) * Far,
+			PersianCollision::GetQueryChannel(), QueryParams)) {
+		Hover.Actor = hitres.GetActor();
+		if (UInstancedStaticMeshComponent const* Instances = APersianInstanceProxy::GetGrabbableInstances(hitres)) {
+			/* Grabbed through a proxy of the mesh, whatever the batch actor is */
+			Hover.bAttachable = PersianSampleCache::FindOrBuild(Instances->GetStaticMesh(), Viewer->PlacementGeometry) != nullptr;
+		} else {
+			Hover.bAttachable = this->IsAttachable(hitres.GetActor(), Viewer->PlacementGeometry);
+		}
+	}
+	return Hover;
+}
@@ -0,0 +1,75 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PersianSampleData.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PersianAttachableRegistry.generated.h"
+
+class UForcedPerspectiveComponent;
+
+/** What UForcedPerspectiveComponent::Attach needs to know about an actor before doing any work */
+struct FAttachableInfo
+{
+	/** Movable, or stationary, and has placement samples */
+	bool bAttachable = false;
+	/** Geometry NumSamples was counted for */
+	EPlacementGeometry Geometry = EPlacementGeometry::Collision;
+	/** Bounds of the actor's components in its own unscaled space */
+	FBox LocalBounds = FBox(ForceInit);
+	/** Mesh-space samples over every static mesh component, before the view-dependent reduction */
+	int32 NumSamples = 0;
+};
+
+/** Result of the hover query of a viewer for one frame */
+struct FHoverResult
+{
+	TWeakObjectPtr<AActor> Actor;
+	bool bAttachable = false;
+	uint64 Frame = MAX_uint64;
+};
+
+/**
+ * Caches, per actor, whether it can be grabbed along with its bounds and
+ * sample count.  Actors register on first lookup, when hovered or grabbed,
+ * and leave when destroyed.
+ *
+ * Also answers what each player looks at, with at most one simple-collision
+ * trace per viewer and frame however many times it is asked, and applies the
+ * PersianCollision opt-in and opt-out tags of every actor as it spawns or its
+ * level is loaded.
+ */
+UCLASS()
+class UPersianAttachableRegistry : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+
+	/** Cached info of Actor, computed now if it is not registered yet or was registered for another geometry */
+	FAttachableInfo const& FindOrRegister(AActor* Actor, EPlacementGeometry Geometry);
+	bool IsAttachable(AActor* Actor, EPlacementGeometry Geometry) { return this->FindOrRegister(Actor, Geometry).bAttachable; }
+	/** Drops the cached info of Actor, e.g. after changing its mobility or meshes */
+	void Unregister(AActor* Actor);
+
+	/** What Viewer looks at within Far this frame, remembered until the owner of Viewer is destroyed */
+	FHoverResult const& GetHover(UForcedPerspectiveComponent const* Viewer, double Far = 1500);
+
+private:
+	TMap<TWeakObjectPtr<AActor>, FAttachableInfo> Infos;
+	TMap<TWeakObjectPtr<UForcedPerspectiveComponent const>, FHoverResult> Hovers;
+	FDelegateHandle ActorSpawnedHandle;
+	FDelegateHandle LevelAddedHandle;
+
+	void OnActorSpawned(AActor* Actor);
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	UFUNCTION()
+	void OnActorDestroyed(AActor* Actor);
+	/* Drops the hover entries of the viewers of Actor, and those of viewers already gone */
+	UFUNCTION()
+	void OnViewerDestroyed(AActor* Actor);
+};
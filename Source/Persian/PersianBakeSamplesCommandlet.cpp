@@ -0,0 +1,101 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianBakeSamplesCommandlet.h"
+#include "PersianSampleData.h"
+#include "AssetRegistryModule.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/LevelStreaming.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "Misc/PackageName.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogPersianBake, Log, All);
+
+UPersianBakeSamplesCommandlet::UPersianBakeSamplesCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UPersianBakeSamplesCommandlet::Main(const FString& Params)
+{
+#if WITH_EDITOR
+	int32 Budget = PersianSampleCache::GetBakeBudget();
+	FParse::Value(*Params, TEXT("Budget="), Budget);
+
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get();
+	AssetRegistry.SearchAllAssets(true);
+	TArray<FAssetData> Maps;
+	AssetRegistry.GetAssetsByClass(UWorld::StaticClass()->GetFName(), Maps);
+
+	/* Meshes of every actor Attach would accept, in the persistent level and every streamed sublevel of each map */
+	TSet<UStaticMesh*> Meshes;
+	TSet<FName> Scanned;
+	TArray<FName> Queue;
+	for (FAssetData const& Map : Maps) {
+		Queue.Add(Map.PackageName);
+	}
+	while (Queue.Num() > 0) {
+		FName const PackageName = Queue.Pop(false);
+		if (Scanned.Contains(PackageName)) {
+			continue;
+		}
+		Scanned.Add(PackageName);
+		UPackage* Package = LoadPackage(nullptr, *PackageName.ToString(), LOAD_None);
+		UWorld* World = Package != nullptr ? UWorld::FindWorldInPackage(Package) : nullptr;
+		if (World == nullptr || World->PersistentLevel == nullptr) {
+			continue;
+		}
+		for (ULevelStreaming const* Streaming : World->GetStreamingLevels()) {
+			if (Streaming != nullptr) {
+				Queue.Add(Streaming->GetWorldAssetPackageFName());
+			}
+		}
+		for (AActor* Actor : World->PersistentLevel->Actors) {
+			if (Actor == nullptr || Actor->GetRootComponent() == nullptr
+				|| Actor->GetRootComponent()->Mobility == EComponentMobility::Static) {
+				continue;
+			}
+			TArray<UStaticMeshComponent*> Components;
+			Actor->GetComponents<UStaticMeshComponent>(Components, true);
+			for (UStaticMeshComponent* Component : Components) {
+				UStaticMesh* Mesh = Component->GetStaticMesh();
+				/* Engine content cannot be saved from here */
+				if (Mesh != nullptr && Mesh->GetOutermost()->GetName().StartsWith(TEXT("/Game/"))) {
+					Meshes.Add(Mesh);
+				}
+			}
+		}
+	}
+
+	int32 NumFailed = 0;
+	for (UStaticMesh* Mesh : Meshes) {
+		UPersianSampleData* Data = Mesh->GetAssetUserData<UPersianSampleData>();
+		if (Data == nullptr) {
+			Data = NewObject<UPersianSampleData>(Mesh);
+			Mesh->AddAssetUserData(Data);
+		}
+		Data->Budget = Budget;
+		Data->Rebuild(Mesh);
+
+		UPackage* Package = Mesh->GetOutermost();
+		Package->MarkPackageDirty();
+		FString const Filename = FPackageName::LongPackageNameToFilename(
+			Package->GetName(), FPackageName::GetAssetPackageExtension());
+		if (UPackage::SavePackage(Package, nullptr, RF_Standalone, *Filename)) {
+			UE_LOG(LogPersianBake, Display, TEXT("%s: %d samples"), *Mesh->GetPathName(), Data->Points.Num());
+		} else {
+			UE_LOG(LogPersianBake, Error, TEXT("Could not save %s"), *Filename);
+			++NumFailed;
+		}
+	}
+	UE_LOG(LogPersianBake, Display, TEXT("Baked placement samples for %d meshes, %d failed"),
+		Meshes.Num() - NumFailed, NumFailed);
+	return NumFailed == 0 ? 0 : 1;
+#else
+	UE_LOG(LogPersianBake, Error, TEXT("PersianBakeSamples needs an editor build"));
+	return 1;
+#endif
+}
@@ -0,0 +1,24 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "PersianBakeSamplesCommandlet.generated.h"
+
+/**
+ * Bakes UPersianSampleData into every project static mesh used by a movable
+ * actor of a project map, and saves the meshes.
+ *
+ * Usage: UE4Editor-Cmd Persian.uproject -run=PersianBakeSamples [-Budget=4096]
+ */
+UCLASS()
+class UPersianBakeSamplesCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UPersianBakeSamplesCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,1106 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+/*
+ * Console commands comparing the different code paths of the forced-perspective
+ * pipeline in a running game, e.g. `-nullrhi -ExecCmds="persian.CompareSolvers"`.
+ */
+
+#include "PersianBenchmarks.h"
+#include "Persian.h"
+#include "ForcedPerspectiveComponent.h"
+#include "PersianCharacter.h"
+#include "PersianCollision.h"
+#include "PersianDepthRaster.h"
+#include "PersianDirections.h"
+#include "PersianPlacementSubsystem.h"
+#include "PersianProjectile.h"
+#include "PersianProjectileManager.h"
+#include "PersianProjectilePool.h"
+#include "PersianSampleData.h"
+#include "PersianSampling.h"
+#include "PersianSession.h"
+#include "PersianStaticScene.h"
+#include "Camera/CameraComponent.h"
+#include "Components/ShapeComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Containers/Ticker.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/TriggerBox.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/MemoryBase.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "StaticMeshAttributes.h"
+#include "Templates/Atomic.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogPersianBench, Log, All);
+
+/* Character possessed by the first local player, if it is one of ours */
+static APersianCharacter* GetBenchCharacter(UWorld* World) {
+	APersianCharacter* Character = World ? Cast<APersianCharacter>(UGameplayStatics::GetPlayerPawn(World, 0)) : nullptr;
+	if (Character == nullptr) {
+		UE_LOG(LogPersianBench, Warning, TEXT("No APersianCharacter is possessed by player 0"));
+	}
+	return Character;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CompareSolversCommand(
+	TEXT("persian.CompareSolvers"),
+	TEXT("Solves the placement of the held object with every solver and logs scales and timings.\n")
+	TEXT("Usage: persian.CompareSolvers [Far=50000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		UForcedPerspectiveComponent* Holder = Character != nullptr ? Character->GetForcedPerspective() : nullptr;
+		if (Holder == nullptr || Holder->Attaching() == nullptr) {
+			UE_LOG(LogPersianBench, Warning, TEXT("Hold an object before comparing solvers"));
+			return;
+		}
+		double const Far = Args.Num() > 0 ? FCString::Atod(*Args[0]) : 50000;
+
+		double Start = FPlatformTime::Seconds();
+		double const RayScale = Holder->SolvePlacementScale(Holder->GetDirections(), Far);
+		double const RayMs = (FPlatformTime::Seconds() - Start) * 1000;
+
+		Start = FPlatformTime::Seconds();
+		double const SweepScale = Holder->SolveSweepScale(Far);
+		double const SweepMs = (FPlatformTime::Seconds() - Start) * 1000;
+
+		Start = FPlatformTime::Seconds();
+		double const RasterScale = Holder->SolveRasterScale(Far);
+		double const RasterMs = (FPlatformTime::Seconds() - Start) * 1000;
+
+		UE_LOG(LogPersianBench, Log, TEXT("Rays:   scale %f in %.3f ms (%d rays)"),
+			RayScale, RayMs, Holder->GetDirections().Num());
+		UE_LOG(LogPersianBench, Log, TEXT("Sweep:  scale %f in %.3f ms, %+.2f%% from rays"),
+			SweepScale, SweepMs, RayScale > 0 ? (SweepScale / RayScale - 1) * 100 : 0.0);
+		UE_LOG(LogPersianBench, Log, TEXT("Raster: scale %f in %.3f ms at %dx%d, %+.2f%% from rays"),
+			RasterScale, RasterMs, PersianDepthRaster::GetResolution(), PersianDepthRaster::GetResolution(),
+			RayScale > 0 ? (RasterScale / RayScale - 1) * 100 : 0.0);
+	})
+);
+
+static FAutoConsoleCommand BenchDirectionsCommand(
+	TEXT("persian.Bench.Directions"),
+	TEXT("Times the per-vertex direction transforms of the old Attach/MoveAttachedObject loops against\n")
+	TEXT("the bulk kernels on a synthetic mesh.\n")
+	TEXT("Usage: persian.Bench.Directions [NumVertices=100000] [Iterations=20]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](TArray<FString> const& Args) {
+		int32 const NumVertices = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100000;
+		int32 const Iterations = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 20;
+
+		FRandomStream Random(NumVertices);
+		TArray<FVector> Vertices;
+		Vertices.SetNumUninitialized(NumVertices);
+		for (FVector& v : Vertices) {
+			v = Random.GetUnitVector() * Random.FRandRange(10, 100);
+		}
+		FTransform const ObjectTransform(FRotator(10, 20, 30), FVector(500, 40, -20), FVector(1.5f));
+		FVector const CamLocation(0, 0, 60);
+		FRotator const CamRotation(-5, 3, 0);
+
+		double Checksum = 0;
+		double ScalarSeconds = 0;
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration) {
+			double const Start = FPlatformTime::Seconds();
+			FRotator const InvCamRotation = CamRotation.GetInverse();
+			TArray<FVector> Directions;
+			for (FVector const& p : Vertices) {
+				FVector const vert = ObjectTransform.GetLocation() + ObjectTransform.TransformVector(p);
+				Directions.Push(InvCamRotation.RotateVector(vert - CamLocation));
+			}
+			for (FVector const& d : Directions) {
+				FVector const dir = CamRotation.RotateVector(d).GetSafeNormal();
+				Checksum += dir.X / d.Size();
+			}
+			ScalarSeconds += FPlatformTime::Seconds() - Start;
+		}
+
+		double KernelSeconds = 0;
+		FDirectionSamples Samples;
+		TArray<FVector> WorldDirs;
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration) {
+			double const Start = FPlatformTime::Seconds();
+			Samples.Reset();
+			PersianDirections::AppendTransformed(Samples, Vertices.GetData(), Vertices.Num(),
+				PersianDirections::MakeToCameraMatrix(ObjectTransform, CamLocation, CamRotation.Quaternion()));
+			PersianDirections::RotateToWorld(Samples, CamRotation.Quaternion(), WorldDirs);
+			KernelSeconds += FPlatformTime::Seconds() - Start;
+			Checksum -= WorldDirs[0].X / Samples.GetLength(0);
+		}
+
+		UE_LOG(LogPersianBench, Log, TEXT("%d vertices: per-vertex %.3f ms, bulk kernels %.3f ms, %.1fx (checksum %f)"),
+			NumVertices, ScalarSeconds * 1000 / Iterations, KernelSeconds * 1000 / Iterations,
+			ScalarSeconds / FMath::Max(KernelSeconds, SMALL_NUMBER), Checksum);
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs BenchHeldTransformCommand(
+	TEXT("persian.Bench.HeldTransform"),
+	TEXT("Times moving the held object with the former SetActorScale3D + TeleportTo path against the\n")
+	TEXT("single SetActorTransform of ScaleAttachedObject, and against an update skipped for a still camera.\n")
+	TEXT("Usage: persian.Bench.HeldTransform [Iterations=1000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		UForcedPerspectiveComponent* Holder = Character != nullptr ? Character->GetForcedPerspective() : nullptr;
+		AActor* Held = Holder != nullptr ? Holder->Attaching() : nullptr;
+		if (Held == nullptr) {
+			UE_LOG(LogPersianBench, Warning, TEXT("Hold an object before timing its transform updates"));
+			return;
+		}
+		int32 const Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000;
+		double const Scale = Holder->GetHeldScale();
+
+		/* Alternate between two scales so that every update really moves the object */
+		double Start = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; ++i) {
+			FTransform const Target = Holder->ComputeHeldTransform(Scale * (1 + (i & 1) * 0.01));
+			Held->SetActorScale3D(Target.GetScale3D());
+			Held->TeleportTo(Target.GetLocation(), Target.Rotator());
+		}
+		double const TeleportUs = (FPlatformTime::Seconds() - Start) * 1e6 / Iterations;
+
+		Start = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; ++i) {
+			Holder->ScaleAttachedObject(Scale * (1 + (i & 1) * 0.01));
+		}
+		double const TransformUs = (FPlatformTime::Seconds() - Start) * 1e6 / Iterations;
+
+		Holder->ScaleAttachedObject(Scale);
+		Start = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; ++i) {
+			Holder->ScaleAttachedObject(Scale);
+		}
+		double const SkippedUs = (FPlatformTime::Seconds() - Start) * 1e6 / Iterations;
+
+		UE_LOG(LogPersianBench, Log, TEXT("Held transform update: TeleportTo %.2f us, SetActorTransform %.2f us, still camera %.2f us"),
+			TeleportUs, TransformUs, SkippedUs);
+	})
+);
+
+/* Closed, slightly bumpy lat-long sphere of about NumVertices vertices, built at runtime with CPU-readable vertices */
+static UStaticMesh* BuildBenchMesh(int32 NumVertices, TArray<FVector>& OutPositions) {
+	int32 const Rings = FMath::Max(3, FMath::RoundToInt(FMath::Sqrt(NumVertices * 0.5f)));
+	int32 const Segments = FMath::Max(3, NumVertices / Rings);
+
+	FMeshDescription Description;
+	FStaticMeshAttributes Attributes(Description);
+	Attributes.Register();
+	TVertexAttributesRef<FVector> Positions = Attributes.GetVertexPositions();
+	TVertexInstanceAttributesRef<FVector> Normals = Attributes.GetVertexInstanceNormals();
+	Description.ReserveNewVertices(Rings * Segments);
+	Description.ReserveNewVertexInstances(Rings * Segments);
+	FPolygonGroupID const Group = Description.CreatePolygonGroup();
+
+	OutPositions.Reset(Rings * Segments);
+	TArray<FVertexInstanceID> Instances;
+	Instances.Reserve(Rings * Segments);
+	for (int32 r = 0; r < Rings; ++r) {
+		float const Phi = PI * (r + 0.5f) / Rings;
+		for (int32 s = 0; s < Segments; ++s) {
+			float const Theta = 2 * PI * s / Segments;
+			FVector const Normal(FMath::Sin(Phi) * FMath::Cos(Theta), FMath::Sin(Phi) * FMath::Sin(Theta), FMath::Cos(Phi));
+			FVertexID const Vertex = Description.CreateVertex();
+			Positions[Vertex] = Normal * 50 * (1 + 0.1f * FMath::Sin(5 * Theta) * FMath::Sin(3 * Phi));
+			OutPositions.Add(Positions[Vertex]);
+			FVertexInstanceID const Instance = Description.CreateVertexInstance(Vertex);
+			Normals[Instance] = Normal;
+			Instances.Add(Instance);
+		}
+	}
+	for (int32 r = 0; r + 1 < Rings; ++r) {
+		for (int32 s = 0; s < Segments; ++s) {
+			int32 const Next = (s + 1) % Segments;
+			FVertexInstanceID const Lower[] = { Instances[r * Segments + s], Instances[(r + 1) * Segments + s], Instances[r * Segments + Next] };
+			FVertexInstanceID const Upper[] = { Instances[r * Segments + Next], Instances[(r + 1) * Segments + s], Instances[(r + 1) * Segments + Next] };
+			Description.CreateTriangle(Group, Lower);
+			Description.CreateTriangle(Group, Upper);
+		}
+	}
+
+	UStaticMesh* Mesh = NewObject<UStaticMesh>(GetTransientPackage(), NAME_None, RF_Transient);
+	/* Keep the position buffer readable, the sample cache builds from it */
+	Mesh->bAllowCPUAccess = true;
+	Mesh->StaticMaterials.Add(FStaticMaterial());
+	TArray<FMeshDescription const*> Descriptions{ &Description };
+	Mesh->BuildFromMeshDescriptions(Descriptions);
+	return Mesh;
+}
+
+/* Value at Percentile (0-1) of Samples, which gets sorted */
+static double GetPercentile(TArray<double>& Samples, double Percentile) {
+	if (Samples.Num() == 0) {
+		return 0;
+	}
+	Samples.Sort();
+	return Samples[FMath::Clamp(FMath::CeilToInt(Percentile * Samples.Num()) - 1, 0, Samples.Num() - 1)];
+}
+
+/* Release p95 per vertex count of a summary written by persian.Bench.AttachRelease */
+static bool LoadReleaseBaseline(FString const& Path, TMap<int32, double>& OutReleaseP95) {
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadFileToStringArray(Lines, *Path)) {
+		return false;
+	}
+	for (int32 i = 1; i < Lines.Num(); ++i) {
+		TArray<FString> Fields;
+		Lines[i].ParseIntoArray(Fields, TEXT(","));
+		if (Fields.Num() >= 5) {
+			OutReleaseP95.Add(FCString::Atoi(*Fields[0]), FCString::Atod(*Fields[4]));
+		}
+	}
+	return true;
+}
+
+/*
+ * Counts what goes through GMalloc while it is installed in its place, on any
+ * thread.  Never deleted: another thread may still be inside it right after
+ * it is swapped out again.
+ */
+class FPersianCountingMalloc final : public FMalloc
+{
+public:
+	explicit FPersianCountingMalloc(FMalloc* InInner) : Inner(InInner) {}
+
+	FMalloc* GetInner() const { return this->Inner; }
+	void ResetCounts() {
+		this->Allocations = 0;
+		this->AllocatedBytes = 0;
+	}
+	int64 GetAllocations() const { return this->Allocations; }
+	int64 GetAllocatedBytes() const { return this->AllocatedBytes; }
+
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override {
+		++this->Allocations;
+		this->AllocatedBytes += Count;
+		return this->Inner->Malloc(Count, Alignment);
+	}
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override {
+		++this->Allocations;
+		this->AllocatedBytes += Count;
+		return this->Inner->Realloc(Original, Count, Alignment);
+	}
+	virtual void Free(void* Original) override { this->Inner->Free(Original); }
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return this->Inner->QuantizeSize(Count, Alignment); }
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return this->Inner->GetAllocationSize(Original, SizeOut); }
+	virtual void Trim(bool bTrimThreadCaches) override { this->Inner->Trim(bTrimThreadCaches); }
+	virtual void SetupTLSCachesOnCurrentThread() override { this->Inner->SetupTLSCachesOnCurrentThread(); }
+	virtual void ClearAndDisableTLSCachesOnCurrentThread() override { this->Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+	virtual void InitializeStatsMetadata() override { this->Inner->InitializeStatsMetadata(); }
+	virtual void UpdateStats() override { this->Inner->UpdateStats(); }
+	virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { this->Inner->GetAllocatorStats(OutStats); }
+	virtual void DumpAllocatorStats(FOutputDevice& Ar) override { this->Inner->DumpAllocatorStats(Ar); }
+	virtual bool IsInternallyThreadSafe() const override { return this->Inner->IsInternallyThreadSafe(); }
+	virtual bool ValidateHeap() override { return this->Inner->ValidateHeap(); }
+	virtual TCHAR const* GetDescriptiveName() override { return this->Inner->GetDescriptiveName(); }
+
+private:
+	FMalloc* Inner;
+	TAtomic<int64> Allocations{ 0 };
+	TAtomic<int64> AllocatedBytes{ 0 };
+};
+
+/* Installs the counting allocator for its lifetime, reset on entry */
+struct FScopedAllocationCount
+{
+	FScopedAllocationCount() {
+		static FPersianCountingMalloc* Counting = new FPersianCountingMalloc(GMalloc);
+		check(GMalloc == Counting->GetInner());
+		this->Counting = Counting;
+		Counting->ResetCounts();
+		GMalloc = Counting;
+	}
+	~FScopedAllocationCount() {
+		GMalloc = this->Counting->GetInner();
+	}
+	int64 GetAllocations() const { return this->Counting->GetAllocations(); }
+	double GetAllocatedKB() const { return this->Counting->GetAllocatedBytes() / 1024.0; }
+
+private:
+	FPersianCountingMalloc* Counting;
+};
+
+TArray<int32> PersianBench::ParseCountList(TCHAR const* Params, TCHAR const* Match, TCHAR const* Default) {
+	FString List = Default;
+	/* Read past the commas, only whitespace ends the list */
+	FParse::Value(Params, Match, List, false);
+	List.ReplaceInline(TEXT("+"), TEXT(","));
+	TArray<FString> Fields;
+	List.ParseIntoArray(Fields, TEXT(","));
+	TArray<int32> Counts;
+	for (FString const& Field : Fields) {
+		Counts.Add(FCString::Atoi(*Field));
+	}
+	return Counts;
+}
+
+bool PersianBench::RunAttachRelease(UWorld* World, UForcedPerspectiveComponent* Holder, USceneComponent* View,
+	FAttachReleaseOptions const& Options, TArray<FString>& OutErrors) {
+	if (Holder->Attaching() != nullptr) {
+		OutErrors.Add(TEXT("Release the held object before benchmarking"));
+		return false;
+	}
+	int32 const Iterations = FMath::Max(1, Options.Iterations);
+	FQuat const SavedViewRotation = View->GetComponentQuat();
+	FRandomStream Random(0x5e75);
+
+	FString Samples = TEXT("Vertices,Iteration,AttachMs,ReleaseMs,HeldSamples,Allocs,AllocKB\n");
+	FString Summary = TEXT("Vertices,AttachP50Ms,AttachP95Ms,ReleaseP50Ms,ReleaseP95Ms,ColdAttachMs,MeshBuildMs,MeshMemKB\n");
+	TMap<int32, double> ReleaseP95;
+
+	for (int32 const Count : Options.VertexCounts) {
+		int32 const RequestedVertices = FMath::Max(3, Count);
+		double Start = FPlatformTime::Seconds();
+		TArray<FVector> Positions;
+		UStaticMesh* Mesh = BuildBenchMesh(RequestedVertices, Positions);
+		SIZE_T MeshBytes = Mesh->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal);
+		if (Options.bBake) {
+			UPersianSampleData* Baked = NewObject<UPersianSampleData>(Mesh);
+			Baked->Geometry = Holder->PlacementGeometry;
+			Baked->Points = Positions;
+			PersianSampling::ReducePoints(Baked->Points, Baked->Budget);
+			Mesh->AddAssetUserData(Baked);
+			MeshBytes += Baked->Points.GetAllocatedSize();
+		}
+		double const MeshBuildMs = (FPlatformTime::Seconds() - Start) * 1000;
+		double const MeshMemKB = MeshBytes / 1024.0;
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		AStaticMeshActor* Prop = World->SpawnActor<AStaticMeshActor>(FVector::ZeroVector, FRotator::ZeroRotator, SpawnParams);
+		Prop->GetStaticMeshComponent()->SetMobility(EComponentMobility::Movable);
+		Prop->GetStaticMeshComponent()->SetStaticMesh(Mesh);
+
+		TArray<double> AttachMs, ReleaseMs;
+		double ColdAttachMs = 0;
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration) {
+			/* Scripted pose: look somewhere, with the prop right in front of the camera */
+			View->SetWorldRotation(FRotator(Random.FRandRange(-30, 30), Random.FRandRange(-180, 180), 0));
+			FVector const CamLocation = View->GetComponentLocation();
+			FVector const Forward = View->GetForwardVector();
+			FVector const PropLocation = CamLocation + Forward * Random.FRandRange(200, 800);
+			Prop->SetActorLocationAndRotation(PropLocation, FRotator(0, Random.FRandRange(0, 360), 0),
+				false, nullptr, ETeleportType::TeleportPhysics);
+
+			double AttachTime = 0, ReleaseTime = 0;
+			bool bAttached = false;
+			int32 HeldSamples = 0;
+			int64 Allocs = 0;
+			double AllocKB = 0;
+			{
+				FScopedAllocationCount const Allocations;
+				/* Same calls as OnFire */
+				Start = FPlatformTime::Seconds();
+				bAttached = Holder->Attach(Prop, PropLocation - Forward * 40);
+				if (bAttached) {
+					Prop->SetActorEnableCollision(false);
+					Holder->ScaleAttachedObject(30.0 / FMath::Max(1.0, (PropLocation - CamLocation).Size()));
+				}
+				AttachTime = (FPlatformTime::Seconds() - Start) * 1000;
+				if (bAttached) {
+					HeldSamples = Holder->GetDirections().Num();
+					View->AddWorldRotation(FRotator(Random.FRandRange(-10, 10), Random.FRandRange(-10, 10), 0));
+					Start = FPlatformTime::Seconds();
+					Holder->MoveAttachedObject();
+					Prop->SetActorEnableCollision(true);
+					Holder->Detach();
+					ReleaseTime = (FPlatformTime::Seconds() - Start) * 1000;
+				}
+				Allocs = Allocations.GetAllocations();
+				AllocKB = Allocations.GetAllocatedKB();
+			}
+			if (!bAttached) {
+				OutErrors.Add(FString::Printf(TEXT("Could not attach the %d vertex prop"), RequestedVertices));
+				break;
+			}
+
+			if (Iteration == 0) {
+				ColdAttachMs = AttachTime;
+			}
+			AttachMs.Add(AttachTime);
+			ReleaseMs.Add(ReleaseTime);
+			Samples += FString::Printf(TEXT("%d,%d,%.4f,%.4f,%d,%lld,%.1f\n"),
+				Positions.Num(), Iteration, AttachTime, ReleaseTime, HeldSamples, Allocs, AllocKB);
+		}
+		Prop->Destroy();
+		if (ReleaseMs.Num() == 0) {
+			continue;
+		}
+
+		double const AttachP50 = GetPercentile(AttachMs, 0.5), AttachP95 = GetPercentile(AttachMs, 0.95);
+		double const ReleaseP50 = GetPercentile(ReleaseMs, 0.5);
+		ReleaseP95.Add(Positions.Num(), GetPercentile(ReleaseMs, 0.95));
+		Summary += FString::Printf(TEXT("%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f,%.1f\n"), Positions.Num(),
+			AttachP50, AttachP95, ReleaseP50, ReleaseP95[Positions.Num()], ColdAttachMs, MeshBuildMs, MeshMemKB);
+		UE_LOG(LogPersianBench, Log, TEXT("%d vertices: attach p50 %.3f ms p95 %.3f ms (cold %.3f ms), release p50 %.3f ms p95 %.3f ms"),
+			Positions.Num(), AttachP50, AttachP95, ColdAttachMs, ReleaseP50, ReleaseP95[Positions.Num()]);
+	}
+	View->SetWorldRotation(SavedViewRotation);
+
+	FString const Stem = FPaths::ProfilingDir() / TEXT("Persian") / FString::Printf(TEXT("AttachRelease-%s"),
+		*FDateTime::Now().ToString());
+	FFileHelper::SaveStringToFile(Samples, *(Stem + TEXT(".csv")));
+	FFileHelper::SaveStringToFile(Summary, *(Stem + TEXT("-Summary.csv")));
+	UE_LOG(LogPersianBench, Log, TEXT("Wrote %s.csv and %s-Summary.csv"), *Stem, *Stem);
+
+	if (Options.BaselinePath.IsEmpty()) {
+		return OutErrors.Num() == 0;
+	}
+	TMap<int32, double> Baseline;
+	if (!LoadReleaseBaseline(Options.BaselinePath, Baseline)) {
+		OutErrors.Add(FString::Printf(TEXT("Could not read the baseline %s"), *Options.BaselinePath));
+		return false;
+	}
+	bool bRegressed = false;
+	for (TPair<int32, double> const& Measured : ReleaseP95) {
+		double const* Reference = Baseline.Find(Measured.Key);
+		if (Reference == nullptr) {
+			continue;
+		}
+		double const Change = *Reference > 0 ? (Measured.Value / *Reference - 1) * 100 : 0;
+		if (Change > Options.Threshold) {
+			OutErrors.Add(FString::Printf(TEXT("%d vertices: release p95 %.3f ms is %+.1f%% over the baseline %.3f ms"),
+				Measured.Key, Measured.Value, Change, *Reference));
+			bRegressed = true;
+		}
+	}
+	if (!bRegressed) {
+		UE_LOG(LogPersianBench, Log, TEXT("Release p95 within %.1f%% of %s"), Options.Threshold, *Options.BaselinePath);
+	}
+	return OutErrors.Num() == 0;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchAttachReleaseCommand(
+	TEXT("persian.Bench.AttachRelease"),
+	TEXT("Grabs and releases procedural props of growing vertex counts from scripted camera poses, writes\n")
+	TEXT("per-grab timings and allocations to Saved/Profiling/Persian, and fails the run when the release p95\n")
+	TEXT("regresses past a baseline summary. Meant for `-nullrhi -unattended -ExecCmds=\"persian.Bench.AttachRelease, quit\"`,\n")
+	TEXT("where vertex counts are separated with '+' since -ExecCmds splits on commas.\n")
+	TEXT("Usage: persian.Bench.AttachRelease [Vertices=100+1000+10000+100000+1000000] [Iterations=20] [Bake=0]\n")
+	TEXT("       [Baseline=<summary csv>] [Threshold=10 (percent)]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		if (Character == nullptr) {
+			return;
+		}
+		FString const Params = FString::Join(Args, TEXT(" "));
+		PersianBench::FAttachReleaseOptions Options;
+		Options.VertexCounts = PersianBench::ParseCountList(*Params, TEXT("Vertices="), TEXT("100,1000,10000,100000,1000000"));
+		FParse::Value(*Params, TEXT("Iterations="), Options.Iterations);
+		FParse::Bool(*Params, TEXT("Bake="), Options.bBake);
+		FParse::Value(*Params, TEXT("Baseline="), Options.BaselinePath);
+		FParse::Value(*Params, TEXT("Threshold="), Options.Threshold);
+
+		TArray<FString> Errors;
+		bool const bPassed = PersianBench::RunAttachRelease(World, Character->GetForcedPerspective(),
+			Character->GetFirstPersonCameraComponent(), Options, Errors);
+		for (FString const& Error : Errors) {
+			UE_LOG(LogPersianBench, Error, TEXT("%s"), *Error);
+		}
+		if (!bPassed && FApp::IsUnattended()) {
+			FPlatformMisc::RequestExitWithStatus(false, 1);
+		}
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs BenchHoldersCommand(
+	TEXT("persian.Bench.Holders"),
+	TEXT("Times the release solves of several simultaneous holders, one after the other against a single\n")
+	TEXT("batched flush of the placement subsystem. Extra holders are spawned next to player 0.\n")
+	TEXT("Usage: persian.Bench.Holders [Holders=1+4+32] [Vertices=10000] [Iterations=10]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		UPersianPlacementSubsystem* Placement = World ? World->GetSubsystem<UPersianPlacementSubsystem>() : nullptr;
+		if (Character == nullptr || Placement == nullptr) {
+			return;
+		}
+		if (Character->Attaching() != nullptr) {
+			UE_LOG(LogPersianBench, Warning, TEXT("Release the held object before benchmarking"));
+			return;
+		}
+		FString const Params = FString::Join(Args, TEXT(" "));
+		TArray<int32> const HolderCounts = PersianBench::ParseCountList(*Params, TEXT("Holders="), TEXT("1,4,32"));
+		int32 NumVertices = 10000;
+		FParse::Value(*Params, TEXT("Vertices="), NumVertices);
+		int32 Iterations = 10;
+		FParse::Value(*Params, TEXT("Iterations="), Iterations);
+		Iterations = FMath::Max(1, Iterations);
+
+		TArray<FVector> Positions;
+		UStaticMesh* Mesh = BuildBenchMesh(NumVertices, Positions);
+		FRandomStream Random(0x401d);
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		for (int32 const Count : HolderCounts) {
+			int32 const NumHolders = FMath::Max(1, Count);
+			TArray<APersianCharacter*> Characters{ Character };
+			TArray<UForcedPerspectiveComponent*> Holders{ Character->GetForcedPerspective() };
+			TArray<AActor*> Props;
+			for (int32 h = 0; h < NumHolders; ++h) {
+				if (h > 0) {
+					FVector const Offset(200 * (h % 8), 200 * (h / 8), 0);
+					Characters.Add(World->SpawnActor<APersianCharacter>(Character->GetClass(),
+						Character->GetActorLocation() + Offset, Character->GetActorRotation(), SpawnParams));
+					Holders.Add(Characters[h]->GetForcedPerspective());
+				}
+				UCameraComponent* Camera = Characters[h]->GetFirstPersonCameraComponent();
+				Camera->SetWorldRotation(FRotator(Random.FRandRange(-20, 20), Random.FRandRange(-180, 180), 0));
+				FVector const PropLocation = Camera->GetComponentLocation() + Camera->GetForwardVector() * 300;
+				AStaticMeshActor* Prop = World->SpawnActor<AStaticMeshActor>(PropLocation, FRotator::ZeroRotator, SpawnParams);
+				Prop->GetStaticMeshComponent()->SetMobility(EComponentMobility::Movable);
+				Prop->GetStaticMeshComponent()->SetStaticMesh(Mesh);
+				Props.Add(Prop);
+				Holders[h]->Attach(Prop, PropLocation - Camera->GetForwardVector() * 40);
+				Prop->SetActorEnableCollision(false);
+			}
+
+			double Checksum = 0;
+			double Start = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration) {
+				for (UForcedPerspectiveComponent* Holder : Holders) {
+					Checksum += Holder->SolvePlacementScale(Holder->GetDirections(), 50000);
+				}
+			}
+			double const SerialMs = (FPlatformTime::Seconds() - Start) * 1000 / Iterations;
+
+			Start = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration) {
+				for (UForcedPerspectiveComponent* Holder : Holders) {
+					Placement->RequestPlacement(Holder, 50000, [&Checksum](double Scale) { Checksum -= Scale; });
+				}
+				Placement->FlushPlacements();
+			}
+			double const BatchedMs = (FPlatformTime::Seconds() - Start) * 1000 / Iterations;
+
+			UE_LOG(LogPersianBench, Log, TEXT("%d holders: one by one %.3f ms (%.3f ms each), batched %.3f ms (%.3f ms each), %.1fx (checksum %f)"),
+				NumHolders, SerialMs, SerialMs / NumHolders, BatchedMs, BatchedMs / NumHolders,
+				SerialMs / FMath::Max(BatchedMs, SMALL_NUMBER), Checksum);
+
+			for (int32 h = 0; h < Holders.Num(); ++h) {
+				Holders[h]->Detach();
+				Props[h]->Destroy();
+				if (h > 0) {
+					Characters[h]->Destroy();
+				}
+			}
+		}
+	})
+);
+
+static FAutoConsoleCommandWithWorld NetStatsCommand(
+	TEXT("persian.Net.Stats"),
+	TEXT("Logs what the grab state of every holder costs to replicate, against persian.Net.BudgetBytesPerSec,\n")
+	TEXT("and the total outgoing rate of every connection. Run it on the server of a multi-client session."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World) {
+		if (World == nullptr) {
+			return;
+		}
+		IConsoleVariable const* Budget = IConsoleManager::Get().FindConsoleVariable(TEXT("persian.Net.BudgetBytesPerSec"));
+		int32 Holders = 0;
+		for (TObjectIterator<UForcedPerspectiveComponent> It; It; ++It) {
+			if (It->GetWorld() != World || It->IsTemplate()) {
+				continue;
+			}
+			if (It->Attaching() != nullptr) {
+				++Holders;
+			}
+			UE_LOG(LogPersianBench, Log, TEXT("%s: %s, held state %.1f B/s per client (budget %d B/s)"),
+				*GetNameSafe(It->GetOwner()), It->Attaching() != nullptr ? *It->Attaching()->GetName() : TEXT("not holding"),
+				It->GetHeldNetBytesPerSecond(), Budget != nullptr ? Budget->GetInt() : 0);
+		}
+		UNetDriver const* NetDriver = World->GetNetDriver();
+		if (NetDriver == nullptr) {
+			UE_LOG(LogPersianBench, Log, TEXT("Not networked"));
+			return;
+		}
+		TArray<UNetConnection*> Connections = NetDriver->ClientConnections;
+		if (NetDriver->ServerConnection != nullptr) {
+			Connections.Add(NetDriver->ServerConnection);
+		}
+		for (UNetConnection const* Connection : Connections) {
+			UE_LOG(LogPersianBench, Log, TEXT("%s: %d B/s out, %d B/s in, %d holders"),
+				*Connection->LowLevelGetRemoteAddress(), Connection->OutBytesPerSecond, Connection->InBytesPerSecond, Holders);
+		}
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs BenchVisionHitCommand(
+	TEXT("persian.Bench.VisionHit"),
+	TEXT("Times the complex-only grab trace against the two-phase one over rays spread around the view of\n")
+	TEXT("player 0, and counts the rays where both disagree. Best run in a dense level.\n")
+	TEXT("Usage: persian.Bench.VisionHit [Rays=2000] [Far=1500] [ConeDegrees=60]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		if (Character == nullptr) {
+			return;
+		}
+		FString const Params = FString::Join(Args, TEXT(" "));
+		int32 NumRays = 2000;
+		FParse::Value(*Params, TEXT("Rays="), NumRays);
+		NumRays = FMath::Max(1, NumRays);
+		float Far = 1500;
+		FParse::Value(*Params, TEXT("Far="), Far);
+		float ConeDegrees = 60;
+		FParse::Value(*Params, TEXT("ConeDegrees="), ConeDegrees);
+
+		UCameraComponent const* Camera = Character->GetFirstPersonCameraComponent();
+		FVector const Start = Camera->GetComponentLocation();
+		FRandomStream Random(NumRays);
+		TArray<FVector> Dirs;
+		for (int32 i = 0; i < NumRays; ++i) {
+			Dirs.Add(Random.VRandCone(Camera->GetForwardVector(), FMath::DegreesToRadians(ConeDegrees * 0.5f)));
+		}
+
+		TArray<FHitResult> Complex, TwoPhase;
+		Complex.SetNum(NumRays);
+		TwoPhase.SetNum(NumRays);
+		double Start0 = FPlatformTime::Seconds();
+		for (int32 i = 0; i < NumRays; ++i) {
+			Complex[i] = Character->TraceVision(Start, Dirs[i], Far, false);
+		}
+		double const ComplexUs = (FPlatformTime::Seconds() - Start0) * 1e6 / NumRays;
+		Start0 = FPlatformTime::Seconds();
+		for (int32 i = 0; i < NumRays; ++i) {
+			TwoPhase[i] = Character->TraceVision(Start, Dirs[i], Far, true);
+		}
+		double const TwoPhaseUs = (FPlatformTime::Seconds() - Start0) * 1e6 / NumRays;
+
+		int32 Hits = 0, Mismatches = 0;
+		for (int32 i = 0; i < NumRays; ++i) {
+			Hits += Complex[i].bBlockingHit;
+			if (Complex[i].bBlockingHit != TwoPhase[i].bBlockingHit || Complex[i].GetActor() != TwoPhase[i].GetActor()
+				|| !Complex[i].Location.Equals(TwoPhase[i].Location, 0.01f)) {
+				++Mismatches;
+			}
+		}
+		UE_LOG(LogPersianBench, Log, TEXT("%d rays (%d hits): complex %.2f us, two-phase %.2f us per ray, %.1fx, %d mismatches"),
+			NumRays, Hits, ComplexUs, TwoPhaseUs, ComplexUs / FMath::Max(TwoPhaseUs, SMALL_NUMBER), Mismatches);
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs BenchPlacementChannelCommand(
+	TEXT("persian.Bench.PlacementChannel"),
+	TEXT("Times placement rays spread around the view of player 0 on Visibility, ignoring the character only,\n")
+	TEXT("against the ForcedPerspective channel with the precomputed ignore list of its holder. Clutter adds\n")
+	TEXT("overlap volumes and opted-out decoration boxes in front of the player, half and half.\n")
+	TEXT("Usage: persian.Bench.PlacementChannel [Rays=4096] [Far=5000] [ConeDegrees=90] [Clutter=0] [Iterations=10]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		if (Character == nullptr) {
+			return;
+		}
+		FString const Params = FString::Join(Args, TEXT(" "));
+		int32 NumRays = 4096;
+		FParse::Value(*Params, TEXT("Rays="), NumRays);
+		NumRays = FMath::Max(1, NumRays);
+		float Far = 5000;
+		FParse::Value(*Params, TEXT("Far="), Far);
+		float ConeDegrees = 90;
+		FParse::Value(*Params, TEXT("ConeDegrees="), ConeDegrees);
+		int32 Clutter = 0;
+		FParse::Value(*Params, TEXT("Clutter="), Clutter);
+		int32 Iterations = 10;
+		FParse::Value(*Params, TEXT("Iterations="), Iterations);
+		Iterations = FMath::Max(1, Iterations);
+
+		UCameraComponent const* Camera = Character->GetFirstPersonCameraComponent();
+		FVector const Start = Camera->GetComponentLocation();
+		FRandomStream Random(NumRays);
+		TArray<FVector> Dirs;
+		for (int32 i = 0; i < NumRays; ++i) {
+			Dirs.Add(Random.VRandCone(Camera->GetForwardVector(), FMath::DegreesToRadians(ConeDegrees * 0.5f)));
+		}
+
+		TArray<AActor*> Spawned;
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		for (int32 i = 0; i < Clutter; ++i) {
+			FVector const Location = Start + Random.VRandCone(Camera->GetForwardVector(),
+				FMath::DegreesToRadians(ConeDegrees * 0.5f)) * Random.FRandRange(100, Far);
+			ATriggerBox* Box = World->SpawnActor<ATriggerBox>(Location, FRotator(0, Random.FRandRange(0, 360), 0), SpawnParams);
+			UShapeComponent* Shape = Box->GetCollisionComponent();
+			Shape->SetWorldScale3D(FVector(Random.FRandRange(0.2f, 2)));
+			if (i & 1) {
+				/* Decoration that blocks visibility, like foliage, kept out of the placement queries by its tag */
+				Shape->SetCollisionProfileName(UCollisionProfile::BlockAllDynamic_ProfileName);
+				Box->Tags.Add(PersianCollision::OptOutTag);
+				PersianCollision::ApplyActorTags(Box);
+			} else {
+				/* Gameplay volume, overlapping everything */
+				Shape->SetCollisionProfileName(TEXT("OverlapAllDynamic"));
+			}
+			Spawned.Add(Box);
+		}
+
+		FCollisionQueryParams OwnerOnly(SCENE_QUERY_STAT(PersianBenchChannel), true);
+		OwnerOnly.AddIgnoredActor(Character);
+		FCollisionQueryParams const& Hierarchy = Character->GetForcedPerspective()->GetPlacementQueryParams();
+		auto TimeRays = [&](ECollisionChannel Channel, FCollisionQueryParams const& QueryParams, int32& OutHits) {
+			OutHits = 0;
+			double const Start0 = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration) {
+				for (FVector const& Dir : Dirs) {
+					FHitResult hitres;
+					OutHits += World->LineTraceSingleByChannel(hitres, Start, Start + Dir * Far, Channel, QueryParams);
+				}
+			}
+			OutHits /= Iterations;
+			return (FPlatformTime::Seconds() - Start0) * 1e6 / (Iterations * NumRays);
+		};
+		int32 VisibilityHits = 0, DedicatedHits = 0;
+		double const VisibilityUs = TimeRays(ECC_Visibility, OwnerOnly, VisibilityHits);
+		double const DedicatedUs = TimeRays(ECC_ForcedPerspective, Hierarchy, DedicatedHits);
+
+		for (AActor* Actor : Spawned) {
+			Actor->Destroy();
+		}
+		UE_LOG(LogPersianBench, Log, TEXT("%d rays, %d clutter actors: Visibility %.2f us per ray (%d hits), ForcedPerspective %.2f us per ray (%d hits), %.1fx"),
+			NumRays, Clutter, VisibilityUs, VisibilityHits, DedicatedUs, DedicatedHits,
+			VisibilityUs / FMath::Max(DedicatedUs, SMALL_NUMBER));
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs BenchStaticBVHCommand(
+	TEXT("persian.Bench.StaticBVH"),
+	TEXT("Times placement rays spread around the view of player 0, in rays per second, through\n")
+	TEXT("LineTraceSingleByChannel and the static BVH alone, on one thread, and through the BVH with its physics\n")
+	TEXT("fallback, whose BVH pass is spread over worker threads. Counts the rays where the BVH and the physics\n")
+	TEXT("scene disagree by more than a unit.\n")
+	TEXT("Usage: persian.Bench.StaticBVH [Rays=65536] [Far=5000] [ConeDegrees=90] [Iterations=10]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		if (Character == nullptr) {
+			return;
+		}
+		UPersianStaticScene const* Scene = World->GetSubsystem<UPersianStaticScene>();
+		if (Scene == nullptr || !Scene->IsBuilt()) {
+			UE_LOG(LogPersianBench, Warning, TEXT("The static BVH is only built once the world has begun play"));
+			return;
+		}
+		FString const Params = FString::Join(Args, TEXT(" "));
+		int32 NumRays = 65536;
+		FParse::Value(*Params, TEXT("Rays="), NumRays);
+		NumRays = FMath::Max(1, NumRays);
+		float Far = 5000;
+		FParse::Value(*Params, TEXT("Far="), Far);
+		float ConeDegrees = 90;
+		FParse::Value(*Params, TEXT("ConeDegrees="), ConeDegrees);
+		int32 Iterations = 10;
+		FParse::Value(*Params, TEXT("Iterations="), Iterations);
+		Iterations = FMath::Max(1, Iterations);
+
+		UCameraComponent const* Camera = Character->GetFirstPersonCameraComponent();
+		FVector const Start = Camera->GetComponentLocation();
+		FRandomStream Random(NumRays);
+		TArray<FVector> Dirs;
+		for (int32 i = 0; i < NumRays; ++i) {
+			Dirs.Add(Random.VRandCone(Camera->GetForwardVector(), FMath::DegreesToRadians(ConeDegrees * 0.5f)));
+		}
+		FCollisionQueryParams const& QueryParams = Character->GetForcedPerspective()->GetPlacementQueryParams();
+
+		TArray<float> Traced, Static, Combined;
+		Traced.SetNumUninitialized(NumRays);
+		Static.SetNumUninitialized(NumRays);
+		Combined.SetNumUninitialized(NumRays);
+		/* Rays per second of Trace, run Iterations times over every ray */
+		auto TimeRays = [&](TFunctionRef<void()> Trace) {
+			double const Start0 = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration) {
+				Trace();
+			}
+			return double(Iterations) * NumRays / FMath::Max(FPlatformTime::Seconds() - Start0, 1e-9);
+		};
+		double const TracedRate = TimeRays([&]() {
+			for (int32 i = 0; i < NumRays; ++i) {
+				FHitResult hitres;
+				World->LineTraceSingleByChannel(hitres, Start, Start + Dirs[i] * Far, ECC_ForcedPerspective, QueryParams);
+				Traced[i] = hitres.bBlockingHit && !hitres.bStartPenetrating ? hitres.Distance : -1;
+			}
+		});
+		double const StaticRate = TimeRays([&]() {
+			Scene->RayCastBVH(Start, Dirs.GetData(), NumRays, Far, Static.GetData());
+		});
+		double const CombinedRate = TimeRays([&]() {
+			Scene->RayCastMulti(Start, Dirs.GetData(), NumRays, Far, QueryParams, Combined.GetData());
+		});
+
+		int32 Hits = 0, Mismatches = 0;
+		for (int32 i = 0; i < NumRays; ++i) {
+			Hits += Traced[i] >= 0;
+			Mismatches += (Traced[i] >= 0) != (Combined[i] >= 0) || FMath::Abs(Traced[i] - Combined[i]) > 1;
+		}
+		UE_LOG(LogPersianBench, Log, TEXT("%d triangles, %d nodes, %.1f KiB, %d primitives left to physics"),
+			Scene->GetNumTriangles(), Scene->GetNumNodes(), Scene->GetAllocatedSize() / 1024.0f, Scene->GetNumUnbaked());
+		UE_LOG(LogPersianBench, Log, TEXT("%d rays (%d hits): LineTraceSingleByChannel %.2f M/s, BVH %.2f M/s, BVH with fallback %.2f M/s, %.1fx, %d mismatches"),
+			NumRays, Hits, TracedRate * 1e-6, StaticRate * 1e-6, CombinedRate * 1e-6,
+			CombinedRate / FMath::Max(TracedRate, SMALL_NUMBER), Mismatches);
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs StressFireCommand(
+	TEXT("persian.StressFire"),
+	TEXT("Makes player 0 fire projectiles on its own.\n")
+	TEXT("Usage: persian.StressFire [ShotsPerSecond=30], 0 stops"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		if (APersianCharacter* Character = GetBenchCharacter(World)) {
+			Character->SetStressFire(Args.Num() > 0 ? FCString::Atof(*Args[0]) : 30);
+		}
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs BenchProjectilesCommand(
+	TEXT("persian.Bench.Projectiles"),
+	TEXT("Times firing and retiring Count projectiles of player 0 by spawning and destroying them against the\n")
+	TEXT("projectile pool, with the garbage collection that follows each round.\n")
+	TEXT("Usage: persian.Bench.Projectiles [Count=500] [Rounds=5]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		UPersianProjectilePool* Pool = World ? World->GetSubsystem<UPersianProjectilePool>() : nullptr;
+		if (Character == nullptr || Pool == nullptr || Character->ProjectileClass == nullptr) {
+			UE_LOG(LogPersianBench, Warning, TEXT("Player 0 needs a ProjectileClass"));
+			return;
+		}
+		int32 const Count = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 500;
+		int32 const Rounds = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 5;
+		/* Far above the level, so that nothing is hit while timing */
+		FTransform const Muzzle(FRotator(90, 0, 0), Character->GetActorLocation() + FVector(0, 0, 100000));
+		TArray<APersianProjectile*> Projectiles;
+		Projectiles.Reserve(Count);
+
+		double SpawnSeconds = 0, SpawnGCSeconds = 0;
+		for (int32 Round = 0; Round < Rounds; ++Round) {
+			double Start = FPlatformTime::Seconds();
+			for (int32 i = 0; i < Count; ++i) {
+				FActorSpawnParameters SpawnParams;
+				SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+				Projectiles.Add(World->SpawnActor<APersianProjectile>(Character->ProjectileClass, Muzzle, SpawnParams));
+			}
+			for (APersianProjectile* Projectile : Projectiles) {
+				Projectile->Destroy();
+			}
+			SpawnSeconds += FPlatformTime::Seconds() - Start;
+			Projectiles.Reset();
+			Start = FPlatformTime::Seconds();
+			CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS, true);
+			SpawnGCSeconds += FPlatformTime::Seconds() - Start;
+		}
+
+		Pool->Prewarm(Character->ProjectileClass, Count);
+		double PoolSeconds = 0, PoolGCSeconds = 0;
+		for (int32 Round = 0; Round < Rounds; ++Round) {
+			double Start = FPlatformTime::Seconds();
+			for (int32 i = 0; i < Count; ++i) {
+				Projectiles.Add(Pool->Acquire(Character->ProjectileClass, Muzzle));
+			}
+			for (APersianProjectile* Projectile : Projectiles) {
+				if (Projectile != nullptr) {
+					Projectile->Retire();
+				}
+			}
+			PoolSeconds += FPlatformTime::Seconds() - Start;
+			Projectiles.Reset();
+			Start = FPlatformTime::Seconds();
+			CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS, true);
+			PoolGCSeconds += FPlatformTime::Seconds() - Start;
+		}
+
+		UE_LOG(LogPersianBench, Log, TEXT("%d projectiles: spawn/destroy %.2f us each + GC %.2f ms, pool %.2f us each + GC %.2f ms (%d parked)"),
+			Count, SpawnSeconds * 1e6 / (Rounds * Count), SpawnGCSeconds * 1000 / Rounds,
+			PoolSeconds * 1e6 / (Rounds * Count), PoolGCSeconds * 1000 / Rounds, Pool->NumParked());
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs BenchProjectileManagerCommand(
+	TEXT("persian.Bench.ProjectileManager"),
+	TEXT("Fires Count projectiles from player 0 into the projectile manager and times its simulation steps.\n")
+	TEXT("Usage: persian.Bench.ProjectileManager [Count=10000] [Frames=120]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		APersianProjectileManager* Manager = APersianProjectileManager::Get(World);
+		if (Character == nullptr || Manager == nullptr) {
+			return;
+		}
+		int32 const Count = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 10000;
+		int32 const Frames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 120;
+		UCameraComponent const* Camera = Character->GetFirstPersonCameraComponent();
+		FRandomStream Random(Count);
+		Manager->Clear();
+		Manager->LifeSpan = FMath::Max(Manager->LifeSpan, Frames / 60.0f + 1);
+		for (int32 i = 0; i < Count; ++i) {
+			FVector const Dir = Random.VRandCone(Camera->GetForwardVector(), FMath::DegreesToRadians(30.0f));
+			Manager->Fire(FTransform(Dir.Rotation(), Camera->GetComponentLocation() + Dir * 100), 3000);
+		}
+
+		TArray<double> FrameMs;
+		for (int32 Frame = 0; Frame < Frames; ++Frame) {
+			double const Start = FPlatformTime::Seconds();
+			Manager->Simulate(1 / 60.0f);
+			FrameMs.Add((FPlatformTime::Seconds() - Start) * 1000);
+		}
+		int32 const Remaining = Manager->Num();
+		Manager->Clear();
+		Manager->LifeSpan = GetDefault<APersianProjectileManager>()->LifeSpan;
+		UE_LOG(LogPersianBench, Log, TEXT("%d projectiles, %d frames: p50 %.3f ms, p95 %.3f ms per step, %d still in flight"),
+			Count, Frames, GetPercentile(FrameMs, 0.5), GetPercentile(FrameMs, 0.95), Remaining);
+	})
+);
+
+/* Time of the startup milestone Name in this process, negative if it was not reached */
+static double GetStartupMark(TCHAR const* Name) {
+	for (PersianStartup::FMark const& Mark : PersianStartup::GetMarks()) {
+		if (Mark.Name == Name) {
+			return Mark.Seconds;
+		}
+	}
+	return -1;
+}
+
+static void ReportStartup(FString const& MapName, bool bExit) {
+	TCHAR const* const Mode = PersianStartup::SyncLoad() ? TEXT("Sync") : TEXT("Async");
+	double const InitGame = GetStartupMark(TEXT("InitGame"));
+	double const FirstFrame = GetStartupMark(TEXT("FirstFrame"));
+	double const BlockedMs = PersianStartup::GetBlocked() * 1000;
+	UE_LOG(LogPersianBench, Log, TEXT("%s loads on %s: InitGame at %.3f s, first frame at %.3f s, %.2f ms blocked on loads"),
+		Mode, *MapName, InitGame, FirstFrame, BlockedMs);
+
+	/* One row per run, compared with the last run of the other mode on the same map */
+	FString const Path = FPaths::ProfilingDir() / TEXT("Persian") / TEXT("Startup.csv");
+	TArray<FString> Rows;
+	FFileHelper::LoadFileToStringArray(Rows, *Path);
+	if (Rows.Num() == 0) {
+		Rows.Add(TEXT("Mode,Map,InitGame,FirstFrame,BlockedMs"));
+	}
+	for (int32 r = Rows.Num() - 1; r > 0; --r) {
+		TArray<FString> Cells;
+		Rows[r].ParseIntoArray(Cells, TEXT(","));
+		if (Cells.Num() == 5 && Cells[0] != Mode && Cells[1] == MapName) {
+			bool const bSync = Cells[0] == TEXT("Sync");
+			double const OtherFirstFrame = FCString::Atod(*Cells[3]);
+			double const OtherBlockedMs = FCString::Atod(*Cells[4]);
+			UE_LOG(LogPersianBench, Log, TEXT("Sync before, async after: first frame at %.3f -> %.3f s, blocked %.2f -> %.2f ms"),
+				bSync ? OtherFirstFrame : FirstFrame, bSync ? FirstFrame : OtherFirstFrame,
+				bSync ? OtherBlockedMs : BlockedMs, bSync ? BlockedMs : OtherBlockedMs);
+			break;
+		}
+	}
+	Rows.Add(FString::Printf(TEXT("%s,%s,%.3f,%.3f,%.2f"), Mode, *MapName, InitGame, FirstFrame, BlockedMs));
+	FFileHelper::SaveStringArrayToFile(Rows, *Path);
+	if (bExit) {
+		FPlatformMisc::RequestExit(false);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchStartupCommand(
+	TEXT("persian.Bench.Startup"),
+	TEXT("Reports the cold-start times of this run once the first frame is drawn, appends them to\n")
+	TEXT("Saved/Profiling/Persian/Startup.csv and compares them with the last run of the other load mode there.\n")
+	TEXT("Run it once as is and once with -ini:Engine:[ConsoleVariables]:persian.Startup.SyncLoad=1, the\n")
+	TEXT("synchronous loads the constructor finders did, e.g. `-unattended -ExecCmds=\"persian.Bench.Startup\"`.\n")
+	TEXT("Quits when done if Exit is set, which it is by default in unattended runs.\n")
+	TEXT("Usage: persian.Bench.Startup [Timeout=30 (seconds to wait for the first frame)] [Exit=0|1]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		FString const Params = FString::Join(Args, TEXT(" "));
+		float Timeout = 30;
+		FParse::Value(*Params, TEXT("Timeout="), Timeout);
+		bool bExit = FApp::IsUnattended();
+		FParse::Bool(*Params, TEXT("Exit="), bExit);
+		FString const MapName = World != nullptr ? World->GetMapName() : FString();
+		/* -ExecCmds runs before the first frame is drawn */
+		double const Deadline = FPlatformTime::Seconds() + Timeout;
+		FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([MapName, bExit, Deadline](float) {
+			bool const bTimedOut = FPlatformTime::Seconds() > Deadline;
+			if (GetStartupMark(TEXT("FirstFrame")) < 0 && !bTimedOut) {
+				return true;
+			}
+			if (bTimedOut) {
+				UE_LOG(LogPersianBench, Warning, TEXT("No frame was drawn, is the HUD an APersianHUD?"));
+			}
+			ReportStartup(MapName, bExit);
+			return false;
+		}));
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs SessionRecordCommand(
+	TEXT("persian.Session.Record"),
+	TEXT("Records the pose and fire presses of player 0 every frame until persian.Session.Stop.\n")
+	TEXT("Usage: persian.Session.Record [Rate=60 (replay frames per second)]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		UPersianSessionSubsystem* Sessions = World->GetSubsystem<UPersianSessionSubsystem>();
+		if (Character == nullptr || Sessions == nullptr) {
+			return;
+		}
+		if (Sessions->IsRecording() || Sessions->IsReplaying()) {
+			UE_LOG(LogPersianBench, Warning, TEXT("A session is already recording or replaying"));
+			return;
+		}
+		FString const Params = FString::Join(Args, TEXT(" "));
+		float Rate = 60;
+		FParse::Value(*Params, TEXT("Rate="), Rate);
+		Sessions->StartRecording(Character, 1.0f / FMath::Max(1.0f, Rate));
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs SessionStopCommand(
+	TEXT("persian.Session.Stop"),
+	TEXT("Stops recording and saves the session to Saved/Persian/Sessions.\n")
+	TEXT("Usage: persian.Session.Stop [Name=Session]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		UPersianSessionSubsystem* Sessions = World->GetSubsystem<UPersianSessionSubsystem>();
+		if (Sessions == nullptr || !Sessions->IsRecording()) {
+			UE_LOG(LogPersianBench, Warning, TEXT("Not recording"));
+			return;
+		}
+		FString const Params = FString::Join(Args, TEXT(" "));
+		FString Name = TEXT("Session");
+		FParse::Value(*Params, TEXT("Name="), Name);
+		Sessions->StopRecording(FSessionFile::GetPath(Name));
+	})
+);
+
+static FAutoConsoleCommandWithWorldAndArgs SessionReplayCommand(
+	TEXT("persian.Session.Replay"),
+	TEXT("Replays a recorded session on player 0 at its fixed time step and writes per-frame frame and solve\n")
+	TEXT("times to Saved/Profiling/Persian. Meant for `-nullrhi -unattended -ExecCmds=\"persian.Session.Replay Name=...\"`,\n")
+	TEXT("quits when done if Exit is set, which it is by default in unattended runs.\n")
+	TEXT("Usage: persian.Session.Replay [Name=Session] [Exit=0|1]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](TArray<FString> const& Args, UWorld* World) {
+		APersianCharacter* Character = GetBenchCharacter(World);
+		UPersianSessionSubsystem* Sessions = World->GetSubsystem<UPersianSessionSubsystem>();
+		if (Character == nullptr || Sessions == nullptr) {
+			return;
+		}
+		if (Sessions->IsRecording() || Sessions->IsReplaying()) {
+			UE_LOG(LogPersianBench, Warning, TEXT("A session is already recording or replaying"));
+			return;
+		}
+		FString const Params = FString::Join(Args, TEXT(" "));
+		FString Name = TEXT("Session");
+		FParse::Value(*Params, TEXT("Name="), Name);
+		bool bExit = FApp::IsUnattended();
+		FParse::Bool(*Params, TEXT("Exit="), bExit);
+
+		FSessionFile Session;
+		FString const Path = FSessionFile::GetPath(Name);
+		if (!Session.Load(Path)) {
+			UE_LOG(LogPersianBench, Error, TEXT("Could not read the session %s"), *Path);
+			if (bExit) {
+				FPlatformMisc::RequestExitWithStatus(false, 1);
+			}
+			return;
+		}
+		if (Session.MapName != World->GetMapName()) {
+			UE_LOG(LogPersianBench, Warning, TEXT("%s was recorded on %s, replaying on %s"),
+				*Name, *Session.MapName, *World->GetMapName());
+		}
+		Sessions->StartReplay(Character, MoveTemp(Session), Name, bExit);
+	})
+);
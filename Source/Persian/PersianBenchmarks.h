@@ -0,0 +1,46 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UForcedPerspectiveComponent;
+class USceneComponent;
+class UWorld;
+
+/**
+ * Benchmarks shared between the persian.Bench.* console commands and the
+ * Persian.Bench automation tests.
+ */
+namespace PersianBench
+{
+	struct FAttachReleaseOptions
+	{
+		/** Vertex counts of the procedural props, one run each */
+		TArray<int32> VertexCounts{ 100, 1000, 10000, 100000, 1000000 };
+		/** Grabs and releases per prop */
+		int32 Iterations = 20;
+		/** Bake the samples of the props instead of extracting them at the first grab */
+		bool bBake = false;
+		/** Summary csv of an earlier run the release p95 is compared with, none when empty */
+		FString BaselinePath;
+		/** Release p95 regression past the baseline that fails the run, in percent */
+		float Threshold = 10;
+	};
+
+	/**
+	 * Grabs and releases procedural props with Holder from scripted poses of
+	 * View, writes per-grab timings and allocations to Saved/Profiling/Persian,
+	 * and compares the release p95 with the baseline.  False with OutErrors
+	 * filled in when the benchmark could not run or regressed.
+	 */
+	bool RunAttachRelease(UWorld* World, UForcedPerspectiveComponent* Holder, USceneComponent* View,
+		FAttachReleaseOptions const& Options, TArray<FString>& OutErrors);
+
+	/**
+	 * Counts listed after Match in Params, e.g. Vertices=100+1000, or Default.
+	 * Takes '+' as well as ',' between counts, since -ExecCmds splits its
+	 * commands on commas.
+	 */
+	TArray<int32> ParseCountList(TCHAR const* Params, TCHAR const* Match, TCHAR const* Default);
+}
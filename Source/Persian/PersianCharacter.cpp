@@ -1,45 +1,43 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "PersianCharacter.h"
+#include "Persian.h"
+#include "ForcedPerspectiveComponent.h"
+#include "PersianCollision.h"
 #include "PersianProjectile.h"
+#include "PersianProjectilePool.h"
+#include "PersianInstanceProxy.h"
+#include "PersianSession.h"
 #include "Animation/AnimInstance.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
 #include "GameFramework/InputSettings.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "Kismet/GameplayStatics.h"
 #include "MotionControllerComponent.h"
 #include "XRMotionControllerBase.h" // for FXRMotionControllerBase::RightHandSourceId
 
-#include <limits>
-
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 
-//////////////////////////////////////////////////////////////////////////
-// FObjectState
-FObjectState::FObjectState() {}
-	FObjectState::FObjectState(double const& dist, FRotator const& cam_rotation,
-		FRotator const &object_rotation, FVector const &offset, FVector const &scale,
-		EComponentMobility::Type const &mobility)
-		: Dist{ dist }, CamRotation{ cam_rotation }, ObjectRotation{ object_rotation },
-		  Offset{ offset }, Scale{ scale }, Mobility{ mobility } {}
+DECLARE_CYCLE_STAT(TEXT("VisionHit"), STAT_PersianVisionHit, STATGROUP_Persian);
+
+static TAutoConsoleVariable<int32> CVarTwoPhaseVisionHit(
+	TEXT("persian.VisionHit.TwoPhase"),
+	0,
+	TEXT("Trace the grab ray against simple collision first, then against the complex collision of the hit\n")
+	TEXT("actor only, past its simple hit, then against the rest of the world up to that hit. Only reports the\n")
+	TEXT("hit of 0, one complex trace all the way, when every primitive blocking the grab channel has simple\n")
+	TEXT("collision: a mesh with complex collision only is missed when no simple shape is in front of it.\n")
+	TEXT("Actors whose simple shapes are not known to enclose their complex ones go through the complex trace."),
+	ECVF_Default);
 
 //////////////////////////////////////////////////////////////////////////
 // APersianCharacter
 
 APersianCharacter::APersianCharacter()
 {
-	this->AttachedObject = nullptr;
-	this->State = FObjectState {
-		std::numeric_limits<double>::lowest(),
-		FRotator{0, 0, 0},
-		FRotator{0, 0, 0},
-		FVector{0, 0, 0},
-		FVector{1},
-		EComponentMobility::Movable,
-	};
-
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(55.f, 96.0f);
 
@@ -103,6 +101,11 @@ APersianCharacter::APersianCharacter()
 
 	// Uncomment the following line to turn motion controllers on by default:
 	//bUsingMotionControllers = true;
+
+	StressFireRate = 0.0f;
+
+	this->ForcedPerspective = CreateDefaultSubobject<UForcedPerspectiveComponent>(TEXT("ForcedPerspective"));
+	this->ForcedPerspective->ViewComponent = FirstPersonCameraComponent;
 }
 
 void APersianCharacter::BeginPlay()
@@ -124,6 +127,16 @@ void APersianCharacter::BeginPlay()
 		VR_Gun->SetHiddenInGame(true, true);
 		Mesh1P->SetHiddenInGame(false, true);
 	}
+
+	// Spawn projectiles now rather than on the first shots
+	if (ProjectileClass != nullptr && HasAuthority())
+	{
+		if (UPersianProjectilePool* Pool = GetWorld()->GetSubsystem<UPersianProjectilePool>())
+		{
+			Pool->Prewarm(ProjectileClass);
+		}
+	}
+	SetStressFire(StressFireRate);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -171,24 +184,66 @@ void APersianCharacter::OnFire()
 			AnimInstance->Montage_Play(FireAnimation, 1.f);
 		}
 	}
-	if (this->AttachedObject == nullptr) {
-		if (GEngine) {
+	if (UPersianSessionSubsystem* Session = this->GetWorld()->GetSubsystem<UPersianSessionSubsystem>()) {
+		Session->NoteFire(this);
+	}
+	UForcedPerspectiveComponent* const Holder = this->ForcedPerspective;
+	if (Holder->AttachedObject == nullptr) {
+		if (PersianDebug::ShowMessages()) {
 			GEngine->AddOnScreenDebugMessage(-1, 5, FColor::Green,
 				TEXT("Attempting to attach object .."));
 		}
 		FHitResult res = this->VisionHit(1500);
-		if (res.Actor.Get() != nullptr && this->Attach(res.Actor.Get(), res.Location)) {
-			this->AttachedObject->SetActorEnableCollision(false);
-			this->ScaleAttachedObject(30.0 / this->State.Dist);
+		if (UInstancedStaticMeshComponent* Instances = APersianInstanceProxy::GetGrabbableInstances(res)) {
+			/* Not predicted: the server spawns the proxy, which this client grabs once it replicates */
+			if (this->GetLocalRole() < ROLE_Authority) {
+				Holder->ServerAttachInstance(Instances, res.Item, res.Location);
+			} else {
+				Holder->GrabInstance(Instances, res.Item, res.Location);
+			}
+			return;
 		}
-	} else {
-		if (GEngine) {
+		/* Attach checks the registry on the actor actually hit, the hover is only a HUD hint */
+		AActor* const Hit = res.Actor.Get();
+		if (Holder->GrabObject(Hit, res.Location) && this->GetLocalRole() < ROLE_Authority) {
+			/* Predicted, the server confirms or takes it back */
+			Holder->ServerAttach(Hit, res.Location);
+		}
+	} else if (!Holder->IsReleasePending()) {
+		if (PersianDebug::ShowMessages()) {
 			GEngine->AddOnScreenDebugMessage(-1, 5, FColor::Green,
 				TEXT("Attempting to detach object .."));
 		}
-		this->MoveAttachedObject();
-		this->AttachedObject->SetActorEnableCollision(true);
-		this->Detach();
+		if (this->GetLocalRole() < ROLE_Authority) {
+			Holder->ServerRelease();
+		}
+		Holder->ReleaseAttachedObject();
+	}
+}
+
+void APersianCharacter::FireProjectile()
+{
+	if (ProjectileClass == nullptr)
+	{
+		return;
+	}
+	const FRotator SpawnRotation = GetControlRotation();
+	// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
+	const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation())
+		+ SpawnRotation.RotateVector(GunOffset);
+	UPersianProjectilePool::SpawnProjectile(GetWorld(), ProjectileClass, FTransform(SpawnRotation, SpawnLocation));
+}
+
+void APersianCharacter::SetStressFire(float ShotsPerSecond)
+{
+	StressFireRate = FMath::Max(0.0f, ShotsPerSecond);
+	if (StressFireRate > 0.0f)
+	{
+		GetWorldTimerManager().SetTimer(StressFireTimer, this, &APersianCharacter::FireProjectile, 1.0f / StressFireRate, true);
+	}
+	else
+	{
+		GetWorldTimerManager().ClearTimer(StressFireTimer);
 	}
 }
 
@@ -306,159 +361,114 @@ bool APersianCharacter::EnableTouchscreenMovement(class UInputComponent* PlayerI
 }
 
 FHitResult APersianCharacter::VisionHit(double const &Far) const {
-	FHitResult ret;
-	FCollisionQueryParams QueryParams;
-	QueryParams.AddIgnoredActor(this);
-	QueryParams.bTraceComplex = true;
-	FVector CamLocation = this->GetFirstPersonCameraComponent()->GetComponentLocation();
-	FVector Forward = this->GetFirstPersonCameraComponent()->GetForwardVector();
-	this->GetWorld()->LineTraceSingleByChannel(ret,
-		CamLocation, CamLocation + Forward * Far,
-		ECollisionChannel::ECC_Visibility,
-		QueryParams
-	);
-	if (GEngine) {
+	PERSIAN_SCOPED_TIMING(VisionHit);
+	FHitResult ret = this->TraceVision(this->GetFirstPersonCameraComponent()->GetComponentLocation(),
+		this->GetFirstPersonCameraComponent()->GetForwardVector(), Far,
+		CVarTwoPhaseVisionHit.GetValueOnGameThread() != 0);
+	if (PersianDebug::ShowMessages()) {
 		GEngine->AddOnScreenDebugMessage(-1, 5, FColor::Black,
 			FString::Printf(TEXT("Hit distance is %f"), ret.Distance));
 	}
 	return ret;
 }
 
-void APersianCharacter::Tick(float DeltaTime) {
-	Super::Tick(DeltaTime);
-
-	this->ScaleAttachedObject(30.0 / this->State.Dist);
-}
-
-void APersianCharacter::ScaleAttachedObject(double const &RelativeScale) {
-	if (this->AttachedObject != nullptr) {
-		/* Update object scale */
-		this->AttachedObject->SetActorScale3D(this->State.Scale * RelativeScale);
-		FVector CamLocation = this->GetFirstPersonCameraComponent()->GetComponentLocation();
-		FVector CamForward = this->GetFirstPersonCameraComponent()->GetForwardVector();
-		FVector RotatedOffset = FRotator(
-			FQuat(this->GetFirstPersonCameraComponent()->GetComponentRotation())
-			* FQuat(this->State.CamRotation.GetInverse())
-		).RotateVector(this->State.Offset);
-		FVector TargetLocation;
-		TargetLocation = CamLocation
-			+ (CamForward * this->State.Dist - RotatedOffset) * RelativeScale
-			// + CamForward * RelativeScale * this->State.Dist
-			// - this->State.Offset * RelativeScale
-			;
-		FRotator TargetRotation = FRotator(
-			FQuat(this->GetFirstPersonCameraComponent()->GetComponentRotation())
-			* FQuat(this->State.CamRotation.GetInverse())
-			* FQuat(this->State.ObjectRotation)
-		);
-
-		/* Update object position and orientation */
-		this->AttachedObject->TeleportTo(TargetLocation, TargetRotation);
+FHitResult APersianCharacter::TraceVision(FVector const &Start, FVector const &Forward, double const &Far, bool bTwoPhase) const {
+	FHitResult ret;
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(PersianVisionHit), true);
+	PersianCollision::AddIgnoredHierarchy(QueryParams, this);
+	ECollisionChannel const Channel = PersianCollision::GetQueryChannel();
+	FVector const End = Start + Forward * Far;
+	if (!bTwoPhase) {
+		this->GetWorld()->LineTraceSingleByChannel(ret, Start, End, Channel, QueryParams);
+		return ret;
 	}
-}
 
-void APersianCharacter::MoveAttachedObject(double const &Far) {
-	if (this->AttachedObject != nullptr) {
-		FVector CamLocation = this->GetFirstPersonCameraComponent()->GetComponentLocation();
-		FVector CamForward = this->GetFirstPersonCameraComponent()->GetForwardVector();
-		FRotator CamRotation = this->GetFirstPersonCameraComponent()->GetComponentRotation();
-		FHitResult hitres, optimhit;
-		optimhit.bBlockingHit = false;
-		optimhit.bStartPenetrating = false;
-		FCollisionQueryParams QueryParams;
-		QueryParams.AddIgnoredActor(this);
-		QueryParams.AddIgnoredActor(this->AttachedObject);
-		QueryParams.bTraceComplex = true;
-
-		double minScale = std::numeric_limits<double>::max();
-
-		for (FVector const& d : this->Directions) {
-			FVector dir = CamRotation.RotateVector(d).GetSafeNormal();
-			this->GetWorld()->LineTraceSingleByChannel(
-				hitres, CamLocation, CamLocation + dir * Far,
-				ECollisionChannel::ECC_Visibility,
-				QueryParams
-			);
-			// DrawDebugLine(this->GetWorld(), CamLocation, hitres.Location, FColor::Yellow, false, 5);
-			if (hitres.bBlockingHit && !hitres.bStartPenetrating) {
-				optimhit = hitres;
-				minScale = FMath::Min<double>(minScale, (hitres.Distance - 1) / d.Size());
-			}
-			minScale = FMath::Min<double>(minScale, Far / d.Size());
+	/*
+	 * Broadphase on simple shapes.  Precondition: every primitive blocking the
+	 * channel has simple collision, so that a miss here is a miss of the
+	 * complex trace as well.
+	 */
+	FCollisionQueryParams SimpleParams = QueryParams;
+	SimpleParams.bTraceComplex = false;
+	FHitResult simple;
+	AActor* const HitActor = this->GetWorld()->LineTraceSingleByChannel(simple, Start, End,
+		Channel, SimpleParams) ? simple.GetActor() : nullptr;
+	if (HitActor == nullptr) {
+		return simple;
+	}
+	TInlineComponentArray<UPrimitiveComponent*> Primitives(HitActor);
+	for (UPrimitiveComponent* Primitive : Primitives) {
+		if (Primitive->IsCollisionEnabled() && Primitive->GetCollisionResponseToChannel(Channel) == ECR_Block
+			&& (Primitive->IsA<UInstancedStaticMeshComponent>() || !PersianCollision::IsHullEnclosing(Primitive))) {
+			/* Instances, which LineTraceComponent does not go through, or complex geometry that may stick out */
+			this->GetWorld()->LineTraceSingleByChannel(ret, Start, End, Channel, QueryParams);
+			return ret;
 		}
-
-		this->ScaleAttachedObject(minScale);
 	}
-}
 
-bool APersianCharacter::Attach(AActor* Object, FVector const &HitLocation) {
-	if (Object == nullptr || Object->GetRootComponent()->Mobility == EComponentMobility::Static) {
-		return false;
-	}
-	this->AttachedObject = Object;
-	/* Disable physics simulation */
-	this->AttachedObject->DisableComponentsSimulatePhysics();
-	FVector centroid, _;
-	this->AttachedObject->GetActorBounds(true, centroid, _);
-	FVector CamLocation = this->GetFirstPersonCameraComponent()->GetComponentLocation();
-	FRotator InvCamRotation = this->GetFirstPersonCameraComponent()->GetComponentRotation().GetInverse();
-	this->State = FObjectState{
-		(HitLocation - CamLocation).Size(),
-		// this->GetActorRotation().GetInverse() + this->AttachedObject->GetActorRotation(),
-		this->GetFirstPersonCameraComponent()->GetComponentRotation(),
-		this->AttachedObject->GetActorRotation(),
-		HitLocation - centroid,
-		this->AttachedObject->GetActorScale3D(),
-		this->AttachedObject->GetRootComponent()->Mobility,
-	};
-	/* Enable movement */
-	this->AttachedObject->GetRootComponent()->SetMobility(EComponentMobility::Movable);
-	TArray<UStaticMeshComponent *> meshes;
-	this->AttachedObject->GetComponents<UStaticMeshComponent>(meshes, true);
-	for (auto meshcomp : meshes) {
-		auto mesh = meshcomp->GetStaticMesh();
-		if (mesh->GetNumVertices(0) > 0) {
-			FPositionVertexBuffer const* verts =
-				&mesh->RenderData->LODResources[0].VertexBuffers.PositionVertexBuffer;
-			for (uint32_t i = 0; i < verts->GetNumVertices(); ++i) {
-				FVector const vert = this->AttachedObject->GetActorLocation()
-					+ this->AttachedObject->GetTransform().TransformVector(verts->VertexPosition(i));
-				this->Directions.Push(
-					InvCamRotation.RotateVector((vert - CamLocation))
-				);
+	/*
+	 * Refine against that actor alone.  Its simple shapes enclose its complex
+	 * geometry, so the complex hit lies between the simple hit and where the
+	 * ray leaves the bounds of the component.
+	 */
+	double const SegmentStart = FMath::Max(0.0, simple.Distance - 1.0);
+	for (UPrimitiveComponent* Primitive : Primitives) {
+		if (!Primitive->IsCollisionEnabled()
+			|| Primitive->GetCollisionResponseToChannel(Channel) != ECR_Block) {
+			continue;
+		}
+		/* Exit distance of the ray from the bounding box, slab by slab */
+		FBox const Box = Primitive->Bounds.GetBox();
+		double Exit = Far;
+		for (int32 Axis = 0; Axis < 3; ++Axis) {
+			if (FMath::Abs(Forward[Axis]) > SMALL_NUMBER) {
+				double const Slab = ((Forward[Axis] > 0 ? Box.Max[Axis] : Box.Min[Axis]) - Start[Axis]) / Forward[Axis];
+				Exit = FMath::Min(Exit, Slab);
+			}
+		}
+		double const SegmentEnd = FMath::Min(Far, Exit + 1.0);
+		FHitResult hitres;
+		if (SegmentStart < SegmentEnd && Primitive->LineTraceComponent(hitres,
+				Start + Forward * SegmentStart, Start + Forward * SegmentEnd, QueryParams)) {
+			double const Distance = (hitres.Location - Start).Size();
+			if (!ret.bBlockingHit || Distance < ret.Distance) {
+				ret = hitres;
+				ret.Distance = Distance;
 			}
 		}
 	}
-	if (GEngine) {
-		GEngine->AddOnScreenDebugMessage(-1, 5, FColor::Yellow,
-			FString::Printf(TEXT("%d directions"), this->Directions.Num()));
+	QueryParams.AddIgnoredActor(HitActor);
+	if (!ret.bBlockingHit) {
+		/* The ray went through a gap of the complex geometry, carry on behind it */
+		this->GetWorld()->LineTraceSingleByChannel(ret, Start, End, Channel, QueryParams);
+		return ret;
 	}
-	/* Do not attach an object with no body */
-	if (this->Directions.Num() == 0) {
-		this->Detach();
-		return false;
+	/*
+	 * Something else may still block first: a complex surface behind its own
+	 * simple shape yet before this hit.  Trace the rest of the world up to the
+	 * hit for it.
+	 */
+	FHitResult nearer;
+	if (this->GetWorld()->LineTraceSingleByChannel(nearer, Start, Start + Forward * ret.Distance, Channel, QueryParams)) {
+		nearer.TraceEnd = End;
+		nearer.Time = nearer.Distance / Far;
+		return nearer;
 	}
-	return true;
+	/* Nothing did: this is the hit a single complex trace reports */
+	ret.bBlockingHit = true;
+	ret.Actor = HitActor;
+	ret.TraceStart = Start;
+	ret.TraceEnd = End;
+	ret.Time = ret.Distance / Far;
+	return ret;
+}
+
+bool APersianCharacter::Attach(AActor* Object, FVector const &HitLocation) {
+	return this->ForcedPerspective->Attach(Object, HitLocation);
 }
 void APersianCharacter::Detach() {
-	if (this->AttachedObject == nullptr) {
-		return;
-	}
-	/* Re-enable physics simulation */
-	Cast<UPrimitiveComponent>(this->AttachedObject->GetRootComponent())->SetSimulatePhysics(true);
-	/* Disable movement */
-	this->AttachedObject->GetRootComponent()->SetMobility(this->State.Mobility);
-	this->AttachedObject = nullptr;
-	this->State = FObjectState {
-		std::numeric_limits<double>::lowest(),
-		FRotator{0, 0, 0},
-		FRotator{0, 0, 0},
-		FVector{0, 0, 0},
-		FVector{1},
-		EComponentMobility::Movable,
-	};
-	this->Directions.Empty();
+	this->ForcedPerspective->Detach();
 }
 AActor* const APersianCharacter::Attaching() const {
-	return this->AttachedObject;
+	return this->ForcedPerspective->Attaching();
 }
@@ -15,23 +15,7 @@ class UCameraComponent;
 class UMotionControllerComponent;
 class UAnimMontage;
 class USoundBase;
-
-USTRUCT()
-struct FObjectState {
-	GENERATED_USTRUCT_BODY()
-
-	FObjectState();
-	FObjectState(double const& dist, FRotator const& cam_rotation,
-		FRotator const &object_rotation, FVector const &offset, FVector const &scale,
-		EComponentMobility::Type const &mobility);
-
-	double Dist;
-	FRotator CamRotation;
-	FRotator ObjectRotation;
-	FVector Offset;
-	FVector Scale;
-	EComponentMobility::Type Mobility;
-};
+class UForcedPerspectiveComponent;
 
 UCLASS(config=Game)
 class APersianCharacter : public ACharacter
@@ -70,6 +54,10 @@ class APersianCharacter : public ACharacter
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
 	UMotionControllerComponent* L_MotionController;
 
+	/** Holds grabbed objects in front of the first person camera */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Persian", meta = (AllowPrivateAccess = "true"))
+	UForcedPerspectiveComponent* ForcedPerspective;
+
 public:
 	APersianCharacter();
 
@@ -93,6 +81,10 @@ class APersianCharacter : public ACharacter
 	UPROPERTY(EditDefaultsOnly, Category=Projectile)
 	TSubclassOf<class APersianProjectile> ProjectileClass;
 
+	/** Shots per second fired on their own, to stress the projectile pool; 0 disables it */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Projectile)
+	float StressFireRate;
+
 	/** Sound to play each time we fire */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	USoundBase* FireSound;
@@ -110,6 +102,8 @@ class APersianCharacter : public ACharacter
 	/** <del>Fires a projectile.</del> */
 	/** New behaviour: play an animation, nothing more. */
 	void OnFire();
+	/* Replays recorded fire presses */
+	friend class UPersianSessionSubsystem;
 
 	/** Resets HMD orientation and position in VR. */
 	void OnResetVR();
@@ -132,6 +126,10 @@ class APersianCharacter : public ACharacter
 	 */
 	void LookUpAtRate(float Rate);
 
+	/** Fires one ProjectileClass projectile from the muzzle, through the projectile pool */
+	void FireProjectile();
+	FTimerHandle StressFireTimer;
+
 	struct TouchData
 	{
 		TouchData() { bIsPressed = false;Location=FVector::ZeroVector;}
@@ -164,13 +162,11 @@ class APersianCharacter : public ACharacter
 	/** Returns FirstPersonCameraComponent subobject **/
 	UCameraComponent* GetFirstPersonCameraComponent() const { return FirstPersonCameraComponent; }
 
-	/**/
-protected:
-	FObjectState State;
-	TArray<FVector> Directions;
-public:
-	UPROPERTY(BlueprintReadOnly, Category = "Persian")
-		AActor* AttachedObject;
+	/** Fires ShotsPerSecond projectiles on a timer, 0 stops */
+	void SetStressFire(float ShotsPerSecond);
+
+	/** Returns ForcedPerspective subobject **/
+	UForcedPerspectiveComponent* GetForcedPerspective() const { return ForcedPerspective; }
 
 	UFUNCTION(BlueprintCallable, Category = "Persian")
 		bool Attach(AActor* Object, FVector const &HitLocation);
@@ -179,10 +175,7 @@ class APersianCharacter : public ACharacter
 	UFUNCTION(BlueprintCallable, Category = "Persian")
 		AActor* const Attaching() const;
 
-	FHitResult VisionHit(double const &Far = 50000) const;
-	// Called every frame?
-	virtual void Tick(float DeltaTime) override;
-	void ScaleAttachedObject(double const &RelativeScale);
-	void MoveAttachedObject(double const &Far = 50000);
+	/** Trace of VisionHit from Start along Forward, complex all the way or simple then refined; see persian.VisionHit.TwoPhase */
+	/** Visibility trace of VisionHit from Start along Forward, complex all the way or simple then refined */
+	FHitResult TraceVision(FVector const &Start, FVector const &Forward, double const &Far, bool bTwoPhase) const;
 };
-
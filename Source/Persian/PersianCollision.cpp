@@ -0,0 +1,68 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianCollision.h"
+#include "Persian.h"
+#include "Components/PrimitiveComponent.h"
+#include "GameFramework/Actor.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarDedicatedChannel(
+	TEXT("persian.Collision.DedicatedChannel"),
+	1,
+	TEXT("Trace the grab and placement queries on the ForcedPerspective channel. 0 traces them on Visibility,\n")
+	TEXT("which also tests triggers and everything else that blocks visibility."),
+	ECVF_Default);
+
+//////////////////////////////////////////////////////////////////////////
+// PersianCollision
+
+namespace PersianCollision
+{
+
+FName const OptInTag(TEXT("ForcedPerspective"));
+FName const OptOutTag(TEXT("NoForcedPerspective"));
+FName const EnclosingHullTag(TEXT("SimpleHullEnclosesComplex"));
+
+ECollisionChannel GetQueryChannel() {
+	return CVarDedicatedChannel.GetValueOnAnyThread() != 0 ? ECC_ForcedPerspective : ECC_Visibility;
+}
+
+bool IsHullEnclosing(UPrimitiveComponent* Primitive) {
+	if (Primitive->ComponentHasTag(EnclosingHullTag)
+		|| (Primitive->GetOwner() != nullptr && Primitive->GetOwner()->ActorHasTag(EnclosingHullTag))) {
+		return true;
+	}
+	UBodySetup const* const BodySetup = Primitive->GetBodySetup();
+	/* Either way both traces test the same shapes */
+	return BodySetup != nullptr && (BodySetup->GetCollisionTraceFlag() == CTF_UseSimpleAsComplex
+		|| BodySetup->GetCollisionTraceFlag() == CTF_UseComplexAsSimple);
+}
+
+void ApplyActorTags(AActor* Actor) {
+	if (Actor == nullptr) {
+		return;
+	}
+	bool const bOptIn = Actor->ActorHasTag(OptInTag);
+	if (!bOptIn && !Actor->ActorHasTag(OptOutTag)) {
+		return;
+	}
+	TInlineComponentArray<UPrimitiveComponent*> Primitives(Actor);
+	for (UPrimitiveComponent* Primitive : Primitives) {
+		Primitive->SetCollisionResponseToChannel(ECC_ForcedPerspective, bOptIn ? ECR_Block : ECR_Ignore);
+	}
+}
+
+void AddIgnoredHierarchy(FCollisionQueryParams &Params, AActor const* Root) {
+	if (Root == nullptr) {
+		return;
+	}
+	Params.AddIgnoredActor(Root);
+	TArray<AActor*> Children;
+	Root->GetAttachedActors(Children);
+	for (AActor const* Child : Children) {
+		AddIgnoredHierarchy(Params, Child);
+	}
+}
+
+}
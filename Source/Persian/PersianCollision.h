@@ -0,0 +1,44 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+
+/**
+ * Trace channel of the grab and placement queries, "ForcedPerspective" in
+ * Config/DefaultEngine.ini.  Blocked by default; pawns, projectiles, triggers,
+ * invisible walls and the other overlap-only profiles ignore it.
+ * ECC_GameTraceChannel1 is the Projectile object channel.
+ */
+#define ECC_ForcedPerspective ECC_GameTraceChannel2
+
+class UPrimitiveComponent;
+struct FCollisionQueryParams;
+
+/** Query filtering of the forced-perspective traces */
+namespace PersianCollision
+{
+	/** Actor tag that makes every primitive of the actor block ECC_ForcedPerspective, whatever its profile */
+	PERSIAN_API extern FName const OptInTag;
+	/** Actor tag that makes every primitive of the actor ignore ECC_ForcedPerspective, e.g. foliage or decoration */
+	PERSIAN_API extern FName const OptOutTag;
+	/** Actor or component tag stating that the simple shapes of its meshes enclose their complex collision */
+	PERSIAN_API extern FName const EnclosingHullTag;
+
+	/** ECC_ForcedPerspective, or ECC_Visibility when persian.Collision.DedicatedChannel is 0.  Any thread */
+	PERSIAN_API ECollisionChannel GetQueryChannel();
+
+	/**
+	 * Whether a trace against the complex collision of Primitive can only hit
+	 * behind where one against its simple shapes does: the mesh traces one as
+	 * the other, or it or its actor carries EnclosingHullTag.
+	 */
+	PERSIAN_API bool IsHullEnclosing(UPrimitiveComponent* Primitive);
+
+	/** Applies the OptInTag or OptOutTag of Actor to the ECC_ForcedPerspective response of its primitives */
+	PERSIAN_API void ApplyActorTags(AActor* Actor);
+
+	/** Ignores Root and every actor attached below it, recursively, in Params */
+	PERSIAN_API void AddIgnoredHierarchy(FCollisionQueryParams &Params, AActor const* Root);
+}
@@ -0,0 +1,305 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianDepthRaster.h"
+#include "Persian.h"
+#include "PersianCollision.h"
+#include "PersianDirections.h"
+#include "PersianPlacementSubsystem.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "PhysicsEngine/BodySetup.h"
+
+#include <limits>
+
+DECLARE_CYCLE_STAT(TEXT("Depth raster build"), STAT_PersianDepthRasterBuild, STATGROUP_Persian);
+DECLARE_CYCLE_STAT(TEXT("Depth raster lookup"), STAT_PersianDepthRasterLookup, STATGROUP_Persian);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Depth raster triangles"), STAT_PersianDepthRasterTriangles, STATGROUP_Persian);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Depth raster fallback rays"), STAT_PersianDepthRasterRays, STATGROUP_Persian);
+
+static TAutoConsoleVariable<int32> CVarDepthRasterResolution(
+	TEXT("persian.DepthRaster.Resolution"),
+	128,
+	TEXT("Side of the depth buffer the depth raster solver draws the scene into, in pixels."),
+	ECVF_Default);
+
+/* Directions closer than this to the side of the camera (cosine) are traced, the window would get too wide */
+static float const MinForward = 0.1f;
+/* Triangles are clipped in front of the camera */
+static float const NearX = 1.0f;
+
+//////////////////////////////////////////////////////////////////////////
+// FDepthRaster
+
+void FDepthRaster::Init(FDirectionSamples const &Dirs, int32 InResolution) {
+	this->Resolution = FMath::Max(4, InResolution);
+	this->Stride = Align(this->Resolution, 4);
+	this->NumTriangles = 0;
+
+	float Lo[2] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	float Hi[2] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+	for (int32 i = 0; i < Dirs.Num(); ++i) {
+		FVector const Unit = Dirs.GetUnit(i);
+		if (Unit.X < MinForward) {
+			continue;
+		}
+		float const Projected[2] = { Unit.Y / Unit.X, Unit.Z / Unit.X };
+		for (int32 Axis = 0; Axis < 2; ++Axis) {
+			Lo[Axis] = FMath::Min(Lo[Axis], Projected[Axis]);
+			Hi[Axis] = FMath::Max(Hi[Axis], Projected[Axis]);
+		}
+	}
+	for (int32 Axis = 0; Axis < 2; ++Axis) {
+		if (Lo[Axis] > Hi[Axis]) {
+			Lo[Axis] = Hi[Axis] = 0;
+		}
+		/* One pixel of margin around the samples, for the neighbourhood lookups */
+		float const Center = 0.5f * (Lo[Axis] + Hi[Axis]);
+		float const Half = 0.5f * FMath::Max(Hi[Axis] - Lo[Axis], 1e-3f) * (this->Resolution + 2.0f) / this->Resolution;
+		Lo[Axis] = Center - Half;
+		Hi[Axis] = Center + Half;
+	}
+	this->MinX = Lo[0];
+	this->MaxX = Hi[0];
+	this->MinY = Lo[1];
+	this->MaxY = Hi[1];
+	this->PixelsPerX = this->Resolution / (this->MaxX - this->MinX);
+	this->PixelsPerY = this->Resolution / (this->MaxY - this->MinY);
+	this->InvDepth.Reset();
+	this->InvDepth.SetNumZeroed(this->Stride * this->Resolution);
+}
+
+void FDepthRaster::AddTriangle(FVector const &A, FVector const &B, FVector const &C) {
+	/* Clip against the near plane, leaving a triangle or a quad */
+	FVector const In[3] = { A, B, C };
+	FVector Clipped[4];
+	int32 NumClipped = 0;
+	for (int32 k = 0; k < 3; ++k) {
+		FVector const &P = In[k], &Q = In[(k + 1) % 3];
+		bool const bPIn = P.X >= NearX, bQIn = Q.X >= NearX;
+		if (bPIn) {
+			Clipped[NumClipped++] = P;
+		}
+		if (bPIn != bQIn) {
+			Clipped[NumClipped++] = P + (Q - P) * ((NearX - P.X) / (Q.X - P.X));
+		}
+	}
+	if (NumClipped < 3) {
+		return;
+	}
+	/* To pixels, with 1/x, which is affine in screen space, as depth */
+	FVector Projected[4];
+	for (int32 k = 0; k < NumClipped; ++k) {
+		float const InvX = 1.0f / Clipped[k].X;
+		Projected[k] = FVector((Clipped[k].Y * InvX - this->MinX) * this->PixelsPerX,
+			(Clipped[k].Z * InvX - this->MinY) * this->PixelsPerY, InvX);
+	}
+	this->RasterizeProjected(Projected[0], Projected[1], Projected[2]);
+	if (NumClipped == 4) {
+		this->RasterizeProjected(Projected[0], Projected[2], Projected[3]);
+	}
+	++this->NumTriangles;
+}
+
+void FDepthRaster::RasterizeProjected(FVector const &A, FVector const &B, FVector const &C) {
+	/* Pixel i is covered when its centre i + 0.5 is */
+	int32 const X0 = FMath::Max(0, FMath::CeilToInt(FMath::Min3(A.X, B.X, C.X) - 0.5f));
+	int32 const X1 = FMath::Min(this->Resolution - 1, FMath::FloorToInt(FMath::Max3(A.X, B.X, C.X) - 0.5f));
+	int32 const Y0 = FMath::Max(0, FMath::CeilToInt(FMath::Min3(A.Y, B.Y, C.Y) - 0.5f));
+	int32 const Y1 = FMath::Min(this->Resolution - 1, FMath::FloorToInt(FMath::Max3(A.Y, B.Y, C.Y) - 0.5f));
+	float const Area = (B.X - A.X) * (C.Y - A.Y) - (B.Y - A.Y) * (C.X - A.X);
+	if (X0 > X1 || Y0 > Y1 || FMath::Abs(Area) < SMALL_NUMBER) {
+		return;
+	}
+
+	/* Edge functions as ex * x + ey * y + ec, each zero on one edge and Area on the opposite vertex */
+	auto Edge = [](FVector const &P, FVector const &Q, float &OutX, float &OutY, float &OutC) {
+		OutX = -(Q.Y - P.Y);
+		OutY = Q.X - P.X;
+		OutC = (Q.Y - P.Y) * P.X - (Q.X - P.X) * P.Y;
+	};
+	float EX[3], EY[3], EC[3];
+	Edge(B, C, EX[0], EY[0], EC[0]);
+	Edge(C, A, EX[1], EY[1], EC[1]);
+	Edge(A, B, EX[2], EY[2], EC[2]);
+	/* Depth from the barycentrics, before orienting the edges */
+	float const InvArea = 1.0f / Area;
+	float const WX = (A.Z * EX[0] + B.Z * EX[1] + C.Z * EX[2]) * InvArea;
+	float const WY = (A.Z * EY[0] + B.Z * EY[1] + C.Z * EY[2]) * InvArea;
+	float const WC = (A.Z * EC[0] + B.Z * EC[1] + C.Z * EC[2]) * InvArea;
+	/* Both windings, so that inside is where every edge is positive */
+	float const Sign = Area > 0 ? 1.0f : -1.0f;
+	VectorRegister const E0X = VectorSetFloat1(EX[0] * Sign), E1X = VectorSetFloat1(EX[1] * Sign), E2X = VectorSetFloat1(EX[2] * Sign);
+	VectorRegister const WXV = VectorSetFloat1(WX);
+	VectorRegister const Zero = VectorZero();
+	VectorRegister const Lanes = MakeVectorRegister(0.5f, 1.5f, 2.5f, 3.5f);
+
+	/* Rows are padded to whole registers, start on one */
+	int32 const XStart = X0 & ~3;
+	for (int32 y = Y0; y <= Y1; ++y) {
+		float const py = y + 0.5f;
+		VectorRegister const E0Row = VectorSetFloat1((EY[0] * py + EC[0]) * Sign);
+		VectorRegister const E1Row = VectorSetFloat1((EY[1] * py + EC[1]) * Sign);
+		VectorRegister const E2Row = VectorSetFloat1((EY[2] * py + EC[2]) * Sign);
+		VectorRegister const WRow = VectorSetFloat1(WY * py + WC);
+		float* const Row = this->InvDepth.GetData() + y * this->Stride;
+		for (int32 x = XStart; x <= X1; x += 4) {
+			VectorRegister const px = VectorAdd(VectorSetFloat1(float(x)), Lanes);
+			VectorRegister const Inside = VectorBitwiseAnd(
+				VectorCompareGE(VectorMultiplyAdd(px, E0X, E0Row), Zero),
+				VectorBitwiseAnd(VectorCompareGE(VectorMultiplyAdd(px, E1X, E1Row), Zero),
+					VectorCompareGE(VectorMultiplyAdd(px, E2X, E2Row), Zero)));
+			VectorRegister const W = VectorMultiplyAdd(px, WXV, WRow);
+			VectorRegister const Old = VectorLoad(Row + x);
+			VectorStore(VectorSelect(Inside, VectorMax(Old, W), Old), Row + x);
+		}
+	}
+}
+
+void FDepthRaster::AddBox(FVector const &Center, FVector const &Extent, FMatrix const &ToCamera) {
+	/* Corner k has its x, y, z on the positive side when bit 0, 1, 2 of k is set */
+	FVector Corners[8];
+	for (int32 k = 0; k < 8; ++k) {
+		Corners[k] = ToCamera.TransformPosition(Center + FVector(
+			(k & 1) ? Extent.X : -Extent.X, (k & 2) ? Extent.Y : -Extent.Y, (k & 4) ? Extent.Z : -Extent.Z));
+	}
+	static int32 const Faces[6][4] = {
+		{ 0, 2, 6, 4 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 5, 7, 6 },
+	};
+	for (int32 const (&Face)[4] : Faces) {
+		this->AddTriangle(Corners[Face[0]], Corners[Face[1]], Corners[Face[2]]);
+		this->AddTriangle(Corners[Face[0]], Corners[Face[2]], Corners[Face[3]]);
+	}
+}
+
+bool FDepthRaster::AddPrimitive(UPrimitiveComponent *Primitive, FTransform const &ToWorld, FMatrix const &WorldToCamera) {
+	UBodySetup const* Body = Primitive->GetBodySetup();
+	if (Body == nullptr || Body->AggGeom.GetElementCount() == 0) {
+		return false;
+	}
+	FMatrix const ToCamera = ToWorld.ToMatrixWithScale() * WorldToCamera;
+	FKAggregateGeom const& Geom = Body->AggGeom;
+	for (FKBoxElem const& Box : Geom.BoxElems) {
+		this->AddBox(FVector::ZeroVector, FVector(Box.X, Box.Y, Box.Z) * 0.5f, Box.GetTransform().ToMatrixWithScale() * ToCamera);
+	}
+	/* Rounded shapes as their boxes, which are never behind them */
+	for (FKSphereElem const& Sphere : Geom.SphereElems) {
+		this->AddBox(Sphere.Center, FVector(Sphere.Radius), ToCamera);
+	}
+	for (FKSphylElem const& Sphyl : Geom.SphylElems) {
+		this->AddBox(FVector::ZeroVector, FVector(Sphyl.Radius, Sphyl.Radius, 0.5f * Sphyl.Length + Sphyl.Radius),
+			Sphyl.GetTransform().ToMatrixWithScale() * ToCamera);
+	}
+	for (FKTaperedCapsuleElem const& Capsule : Geom.TaperedCapsuleElems) {
+		float const Radius = FMath::Max(Capsule.Radius0, Capsule.Radius1);
+		this->AddBox(FVector::ZeroVector, FVector(Radius, Radius, 0.5f * Capsule.Length + Radius),
+			Capsule.GetTransform().ToMatrixWithScale() * ToCamera);
+	}
+	for (FKConvexElem const& Convex : Geom.ConvexElems) {
+		FMatrix const ElemToCamera = Convex.GetTransform().ToMatrixWithScale() * ToCamera;
+		if (Convex.IndexData.Num() < 3) {
+			this->AddBox(Convex.ElemBox.GetCenter(), Convex.ElemBox.GetExtent(), ElemToCamera);
+			continue;
+		}
+		for (int32 k = 0; k + 2 < Convex.IndexData.Num(); k += 3) {
+			this->AddTriangle(ElemToCamera.TransformPosition(Convex.VertexData[Convex.IndexData[k]]),
+				ElemToCamera.TransformPosition(Convex.VertexData[Convex.IndexData[k + 1]]),
+				ElemToCamera.TransformPosition(Convex.VertexData[Convex.IndexData[k + 2]]));
+		}
+	}
+	return true;
+}
+
+float FDepthRaster::GetDistance(FVector const &Unit) const {
+	if (Unit.X < MinForward) {
+		return -2;
+	}
+	int32 const ix = FMath::FloorToInt((Unit.Y / Unit.X - this->MinX) * this->PixelsPerX);
+	int32 const iy = FMath::FloorToInt((Unit.Z / Unit.X - this->MinY) * this->PixelsPerY);
+	if (ix < 0 || iy < 0 || ix >= this->Resolution || iy >= this->Resolution) {
+		return -2;
+	}
+	/* Nearest of the neighbourhood, so that edges between pixel centres are not missed */
+	float MaxInvDepth = 0;
+	for (int32 y = FMath::Max(0, iy - 1); y <= FMath::Min(this->Resolution - 1, iy + 1); ++y) {
+		for (int32 x = FMath::Max(0, ix - 1); x <= FMath::Min(this->Resolution - 1, ix + 1); ++x) {
+			MaxInvDepth = FMath::Max(MaxInvDepth, this->InvDepth[y * this->Stride + x]);
+		}
+	}
+	return MaxInvDepth > 0 ? 1.0f / MaxInvDepth / Unit.X : -1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PersianDepthRaster
+
+namespace PersianDepthRaster
+{
+
+int32 GetResolution() {
+	return FMath::Clamp(CVarDepthRasterResolution.GetValueOnAnyThread(), 4, 1024);
+}
+
+double SolveScale(UWorld* World, FVector const &CamLocation, FQuat const &CamRotation,
+	FDirectionSamples const &Dirs, double const &Far, FCollisionQueryParams const &QueryParams) {
+	FDepthRaster Raster;
+	FMatrix const WorldToCamera = FTranslationMatrix(-CamLocation) * CamRotation.Inverse().ToMatrix();
+	/* World bounds of what has no simple collision to draw, the raster cannot be trusted across them */
+	TArray<FBox> Undrawn;
+	{
+		SCOPE_CYCLE_COUNTER(STAT_PersianDepthRasterBuild);
+		Raster.Init(Dirs, GetResolution());
+		/* Everything blocking inside the box around the pyramid the window spans, out to Far */
+		FVector const Lo(0, FMath::Min(0.0f, Raster.GetMinX()) * Far, FMath::Min(0.0f, Raster.GetMinY()) * Far);
+		FVector const Hi(Far, FMath::Max(0.0f, Raster.GetMaxX()) * Far, FMath::Max(0.0f, Raster.GetMaxY()) * Far);
+		TArray<FOverlapResult> Overlaps;
+		World->OverlapMultiByChannel(Overlaps, CamLocation + CamRotation.RotateVector(0.5f * (Lo + Hi)), CamRotation,
+			PersianCollision::GetQueryChannel(), FCollisionShape::MakeBox(0.5f * (Hi - Lo)), QueryParams);
+		TSet<TPair<UPrimitiveComponent*, int32>> Drawn;
+		for (FOverlapResult const& Overlap : Overlaps) {
+			UPrimitiveComponent* Primitive = Overlap.GetComponent();
+			if (Primitive == nullptr || !Overlap.bBlockingHit) {
+				continue;
+			}
+			/* Instances one by one, at their own transform */
+			UInstancedStaticMeshComponent const* Instances = Cast<UInstancedStaticMeshComponent>(Primitive);
+			int32 const Item = Instances != nullptr ? Overlap.ItemIndex : INDEX_NONE;
+			bool bAlreadyDrawn = false;
+			Drawn.Add(TPair<UPrimitiveComponent*, int32>(Primitive, Item), &bAlreadyDrawn);
+			if (bAlreadyDrawn) {
+				continue;
+			}
+			FTransform ToWorld = Primitive->GetComponentTransform();
+			if (Instances != nullptr && !Instances->GetInstanceTransform(Item, ToWorld, true)) {
+				continue;
+			}
+			if (!Raster.AddPrimitive(Primitive, ToWorld, WorldToCamera)) {
+				Undrawn.AddUnique(Primitive->Bounds.GetBox());
+			}
+		}
+		INC_DWORD_STAT_BY(STAT_PersianDepthRasterTriangles, Raster.GetNumTriangles());
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_PersianDepthRasterLookup);
+	double minScale = std::numeric_limits<double>::max();
+	for (int32 i = 0; i < Dirs.Num(); ++i) {
+		FVector const Unit = Dirs.GetUnit(i);
+		float const Length = Dirs.GetLength(i);
+		float const Distance = Raster.GetDistance(Unit);
+		FVector const Dir = CamRotation.RotateVector(Unit);
+		double scale = Far / Length;
+		if (Distance == -2 || Undrawn.ContainsByPredicate([&](FBox const& Box) {
+				return FMath::LineBoxIntersection(Box, CamLocation, CamLocation + Dir * Far, Dir * Far); })) {
+			/* Out of the window, or possibly blocked by something the raster does not have */
+			INC_DWORD_STAT(STAT_PersianDepthRasterRays);
+			scale = PersianPlacement::TraceSampleScale(World, CamLocation, Dir, Length, Far, QueryParams);
+		} else if (Distance >= 0 && Distance < Far) {
+			/* Same one unit of clearance as the rays */
+			scale = FMath::Min<double>(scale, (Distance - 1) / Length);
+		}
+		minScale = FMath::Min(minScale, scale);
+	}
+	return minScale;
+}
+
+}
@@ -0,0 +1,71 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FDirectionSamples;
+class UPrimitiveComponent;
+class UWorld;
+struct FCollisionQueryParams;
+
+/**
+ * Nearest depth of the scene over the part of the view a held object covers,
+ * rasterized on the CPU into a small square buffer, in the manner of masked
+ * occlusion culling.  Camera space is x forward, y right and z up; the buffer
+ * covers the window [MinX, MaxX] x [MinY, MaxY] of the projected coordinates
+ * (y/x, z/x) and stores the largest 1/x of each pixel centre, four pixels per
+ * vector register.
+ */
+struct FDepthRaster
+{
+	/** Fits the window around the directions of Dirs, which may leave some out when too close to the side */
+	void Init(FDirectionSamples const &Dirs, int32 Resolution);
+
+	/** Rasterizes the triangle A B C, in camera space, from both sides */
+	void AddTriangle(FVector const &A, FVector const &B, FVector const &C);
+	/** Rasterizes the box of half size Extent, transformed to camera space by ToCamera */
+	void AddBox(FVector const &Center, FVector const &Extent, FMatrix const &ToCamera);
+	/** Rasterizes the simple collision of Primitive, placed at ToWorld.  False, drawing nothing, when it has none */
+	bool AddPrimitive(UPrimitiveComponent *Primitive, FTransform const &ToWorld, FMatrix const &WorldToCamera);
+
+	/**
+	 * Distance to the nearest rasterized surface along the camera-space unit
+	 * direction Unit: -1 when there is none, -2 when Unit is out of the window.
+	 */
+	float GetDistance(FVector const &Unit) const;
+
+	/** Projected bounds of the window, in camera space */
+	float GetMinX() const { return this->MinX; }
+	float GetMaxX() const { return this->MaxX; }
+	float GetMinY() const { return this->MinY; }
+	float GetMaxY() const { return this->MaxY; }
+	int32 GetNumTriangles() const { return this->NumTriangles; }
+
+private:
+	int32 Resolution = 0;
+	/* Row length, rounded up to whole vector registers */
+	int32 Stride = 0;
+	float MinX = 0, MaxX = 0, MinY = 0, MaxY = 0;
+	/* Projected coordinates to pixels */
+	float PixelsPerX = 0, PixelsPerY = 0;
+	TArray<float> InvDepth;
+	int32 NumTriangles = 0;
+
+	void RasterizeProjected(FVector const &A, FVector const &B, FVector const &C);
+};
+
+namespace PersianDepthRaster
+{
+	/** Depth buffer size per side, see persian.DepthRaster.Resolution */
+	int32 GetResolution();
+
+	/**
+	 * Largest scale at which every direction of Dirs fits in front of the
+	 * scene, looked up in a depth raster of the simple collision the directions
+	 * look at.  Directions the window leaves out, and those crossing the bounds
+	 * of a primitive without simple collision, are traced as rays.
+	 */
+	double SolveScale(UWorld* World, FVector const &CamLocation, FQuat const &CamRotation,
+		FDirectionSamples const &Dirs, double const &Far, FCollisionQueryParams const &QueryParams);
+}
@@ -0,0 +1,210 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianDirections.h"
+#include "Async/ParallelFor.h"
+#include "Stats/Stats.h"
+
+static_assert(sizeof(FVector) == 3 * sizeof(float), "Kernels below read and write tightly packed FVector arrays");
+
+/* Points per worker task, and the smallest input worth spreading over worker threads */
+static constexpr int32 KernelBlockSize = 4096;
+static constexpr int32 KernelParallelThreshold = 4 * KernelBlockSize;
+
+DECLARE_MEMORY_STAT(TEXT("Persian Direction Samples"), STAT_PersianDirectionSamples, STATGROUP_Memory);
+
+//////////////////////////////////////////////////////////////////////////
+// FDirectionSample
+
+/* Octahedral point of (u, v), not normalized */
+static FORCEINLINE FVector DecodeOct(float u, float v) {
+	FVector n(u, v, 1 - FMath::Abs(u) - FMath::Abs(v));
+	if (n.Z < 0) {
+		float const x = n.X;
+		n.X = (1 - FMath::Abs(n.Y)) * (x >= 0 ? 1 : -1);
+		n.Y = (1 - FMath::Abs(x)) * (n.Y >= 0 ? 1 : -1);
+	}
+	return n;
+}
+
+FDirectionSample FDirectionSample::Encode(FVector const &Unit, float Length) {
+	float u = 0, v = 0;
+	float const L1 = FMath::Abs(Unit.X) + FMath::Abs(Unit.Y) + FMath::Abs(Unit.Z);
+	if (L1 > 0) {
+		u = Unit.X / L1;
+		v = Unit.Y / L1;
+		if (Unit.Z < 0) {
+			/* Fold the lower hemisphere onto the corners of the square */
+			float const FoldedU = (1 - FMath::Abs(v)) * (u >= 0 ? 1 : -1);
+			float const FoldedV = (1 - FMath::Abs(u)) * (v >= 0 ? 1 : -1);
+			u = FoldedU;
+			v = FoldedV;
+		}
+	}
+	FDirectionSample Sample;
+	Sample.OctX = int16(FMath::RoundToInt(FMath::Clamp(u, -1.f, 1.f) * MAX_int16));
+	Sample.OctY = int16(FMath::RoundToInt(FMath::Clamp(v, -1.f, 1.f) * MAX_int16));
+	Sample.Length = Length;
+	return Sample;
+}
+
+FVector FDirectionSample::DecodeUnit() const {
+	return DecodeOct(this->OctX / float(MAX_int16), this->OctY / float(MAX_int16)).GetSafeNormal();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FDirectionSamples
+
+FDirectionSamples::~FDirectionSamples() {
+	this->Samples.Empty();
+	this->UpdateMemoryStat();
+}
+
+void FDirectionSamples::UpdateMemoryStat() {
+	SIZE_T const Bytes = this->Samples.GetAllocatedSize();
+	INC_MEMORY_STAT_BY(STAT_PersianDirectionSamples, Bytes);
+	DEC_MEMORY_STAT_BY(STAT_PersianDirectionSamples, this->TrackedBytes);
+	this->TrackedBytes = Bytes;
+}
+
+void FDirectionSamples::Add(FVector const &d) {
+	float const Len = d.Size();
+	this->Samples.Add(FDirectionSample::Encode(Len > 0 ? d / Len : FVector::ZeroVector, Len));
+	this->UpdateMemoryStat();
+}
+
+int32 FDirectionSamples::AddUninitialized(int32 Count) {
+	int32 const First = this->Samples.AddUninitialized(Count);
+	this->UpdateMemoryStat();
+	return First;
+}
+
+void FDirectionSamples::Gather(TArray<int32> &Indices) {
+	/* Sorted indices never point below their slot, so this can run in place */
+	Indices.Sort();
+	for (int32 i = 0; i < Indices.Num(); ++i) {
+		this->Samples[i] = this->Samples[Indices[i]];
+	}
+	this->Samples.SetNum(Indices.Num(), false);
+}
+
+void FDirectionSamples::Reset() {
+	this->Samples.Reset();
+}
+
+void FDirectionSamples::Empty() {
+	this->Samples.Empty();
+	this->UpdateMemoryStat();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Kernels
+
+namespace PersianDirections
+{
+
+/* Loads 4 packed FVectors as x0y0z0x1 y1z1x2y2 z2x3y3z3 and transposes them */
+static FORCEINLINE void LoadTransposed(float const *Src, VectorRegister &OutX, VectorRegister &OutY, VectorRegister &OutZ) {
+	VectorRegister const r0 = VectorLoad(Src);
+	VectorRegister const r1 = VectorLoad(Src + 4);
+	VectorRegister const r2 = VectorLoad(Src + 8);
+	OutX = VectorShuffle(r0, VectorShuffle(r1, r2, 2, 2, 1, 1), 0, 3, 0, 2);
+	OutY = VectorShuffle(VectorShuffle(r0, r1, 1, 1, 0, 0), VectorShuffle(r1, r2, 3, 3, 2, 2), 0, 2, 0, 2);
+	OutZ = VectorShuffle(VectorShuffle(r0, r1, 2, 2, 1, 1), r2, 0, 2, 0, 3);
+}
+
+/* Inverse of LoadTransposed */
+static FORCEINLINE void StoreTransposed(VectorRegister const &X, VectorRegister const &Y, VectorRegister const &Z, float *Dst) {
+	VectorStore(VectorShuffle(VectorShuffle(X, Y, 0, 0, 0, 0), VectorShuffle(Z, X, 0, 0, 1, 1), 0, 2, 0, 2), Dst);
+	VectorStore(VectorShuffle(VectorShuffle(Y, Z, 1, 1, 1, 1), VectorShuffle(X, Y, 2, 2, 2, 2), 0, 2, 0, 2), Dst + 4);
+	VectorStore(VectorShuffle(VectorShuffle(Z, X, 2, 2, 3, 3), VectorShuffle(Y, Z, 3, 3, 3, 3), 0, 2, 0, 2), Dst + 8);
+}
+
+FMatrix MakeToCameraMatrix(FTransform const &ToWorld, FVector const &CamLocation, FQuat const &CamRotation) {
+	return ToWorld.ToMatrixWithScale()
+		* FTranslationMatrix(-CamLocation)
+		* CamRotation.Inverse().ToMatrix();
+}
+
+/* Transforms Points[Begin, End) into Out starting at sample OutBase */
+static void TransformRange(FDirectionSamples &Out, int32 OutBase, FVector const *Points, int32 Begin, int32 End, FMatrix const &M) {
+	VectorRegister const M00 = VectorSetFloat1(M.M[0][0]), M01 = VectorSetFloat1(M.M[0][1]), M02 = VectorSetFloat1(M.M[0][2]);
+	VectorRegister const M10 = VectorSetFloat1(M.M[1][0]), M11 = VectorSetFloat1(M.M[1][1]), M12 = VectorSetFloat1(M.M[1][2]);
+	VectorRegister const M20 = VectorSetFloat1(M.M[2][0]), M21 = VectorSetFloat1(M.M[2][1]), M22 = VectorSetFloat1(M.M[2][2]);
+	VectorRegister const M30 = VectorSetFloat1(M.M[3][0]), M31 = VectorSetFloat1(M.M[3][1]), M32 = VectorSetFloat1(M.M[3][2]);
+	VectorRegister const Tiny = VectorSetFloat1(SMALL_NUMBER);
+
+	int32 i = Begin;
+	for (; i + 4 <= End; i += 4) {
+		VectorRegister X, Y, Z;
+		LoadTransposed(&Points[i].X, X, Y, Z);
+		VectorRegister const DX = VectorMultiplyAdd(X, M00, VectorMultiplyAdd(Y, M10, VectorMultiplyAdd(Z, M20, M30)));
+		VectorRegister const DY = VectorMultiplyAdd(X, M01, VectorMultiplyAdd(Y, M11, VectorMultiplyAdd(Z, M21, M31)));
+		VectorRegister const DZ = VectorMultiplyAdd(X, M02, VectorMultiplyAdd(Y, M12, VectorMultiplyAdd(Z, M22, M32)));
+		VectorRegister const LenSq = VectorMultiplyAdd(DX, DX, VectorMultiplyAdd(DY, DY, VectorMultiply(DZ, DZ)));
+		VectorRegister const InvLen = VectorReciprocalSqrtAccurate(VectorMax(LenSq, Tiny));
+		float UnitX[4], UnitY[4], UnitZ[4], Len[4];
+		VectorStore(VectorMultiply(DX, InvLen), UnitX);
+		VectorStore(VectorMultiply(DY, InvLen), UnitY);
+		VectorStore(VectorMultiply(DZ, InvLen), UnitZ);
+		VectorStore(VectorMultiply(LenSq, InvLen), Len);
+		FDirectionSample* Dst = Out.GetData() + OutBase + i - Begin;
+		for (int32 k = 0; k < 4; ++k) {
+			Dst[k] = FDirectionSample::Encode(FVector(UnitX[k], UnitY[k], UnitZ[k]), Len[k]);
+		}
+	}
+	for (; i < End; ++i) {
+		FVector const d = M.TransformPosition(Points[i]);
+		float const Len = d.Size();
+		Out.GetData()[OutBase + i - Begin] = FDirectionSample::Encode(Len > 0 ? d / Len : FVector::ZeroVector, Len);
+	}
+}
+
+void AppendTransformed(FDirectionSamples &Out, FVector const *Points, int32 NumPoints, FMatrix const &ToCamera) {
+	if (NumPoints <= 0) {
+		return;
+	}
+	int32 const OutBase = Out.AddUninitialized(NumPoints);
+	int32 const NumBlocks = FMath::DivideAndRoundUp(NumPoints, KernelBlockSize);
+	ParallelFor(NumBlocks, [&](int32 Block) {
+		int32 const Begin = Block * KernelBlockSize;
+		TransformRange(Out, OutBase + Begin, Points, Begin, FMath::Min(NumPoints, Begin + KernelBlockSize), ToCamera);
+	}, NumPoints < KernelParallelThreshold);
+}
+
+void RotateToWorld(FDirectionSamples const &In, FQuat const &CamRotation, TArray<FVector> &OutDirs) {
+	int32 const Num = In.Num();
+	OutDirs.SetNumUninitialized(Num, false);
+	FMatrix const M = CamRotation.ToMatrix();
+	VectorRegister const M00 = VectorSetFloat1(M.M[0][0]), M01 = VectorSetFloat1(M.M[0][1]), M02 = VectorSetFloat1(M.M[0][2]);
+	VectorRegister const M10 = VectorSetFloat1(M.M[1][0]), M11 = VectorSetFloat1(M.M[1][1]), M12 = VectorSetFloat1(M.M[1][2]);
+	VectorRegister const M20 = VectorSetFloat1(M.M[2][0]), M21 = VectorSetFloat1(M.M[2][1]), M22 = VectorSetFloat1(M.M[2][2]);
+
+	VectorRegister const Tiny = VectorSetFloat1(SMALL_NUMBER);
+	FDirectionSample const* Src = In.GetData();
+
+	int32 i = 0;
+	for (; i + 4 <= Num; i += 4) {
+		/* Decode without normalizing, rotations keep the length so normalize once rotated */
+		float OctX[4], OctY[4], OctZ[4];
+		for (int32 k = 0; k < 4; ++k) {
+			FVector const n = DecodeOct(Src[i + k].OctX / float(MAX_int16), Src[i + k].OctY / float(MAX_int16));
+			OctX[k] = n.X;
+			OctY[k] = n.Y;
+			OctZ[k] = n.Z;
+		}
+		VectorRegister const X = VectorLoad(OctX);
+		VectorRegister const Y = VectorLoad(OctY);
+		VectorRegister const Z = VectorLoad(OctZ);
+		VectorRegister const WX = VectorMultiplyAdd(X, M00, VectorMultiplyAdd(Y, M10, VectorMultiply(Z, M20)));
+		VectorRegister const WY = VectorMultiplyAdd(X, M01, VectorMultiplyAdd(Y, M11, VectorMultiply(Z, M21)));
+		VectorRegister const WZ = VectorMultiplyAdd(X, M02, VectorMultiplyAdd(Y, M12, VectorMultiply(Z, M22)));
+		VectorRegister const InvLen = VectorReciprocalSqrtAccurate(VectorMax(
+			VectorMultiplyAdd(WX, WX, VectorMultiplyAdd(WY, WY, VectorMultiply(WZ, WZ))), Tiny));
+		StoreTransposed(VectorMultiply(WX, InvLen), VectorMultiply(WY, InvLen), VectorMultiply(WZ, InvLen), &OutDirs[i].X);
+	}
+	for (; i < Num; ++i) {
+		OutDirs[i] = M.TransformVector(In.GetUnit(i));
+	}
+}
+
+}
@@ -0,0 +1,71 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * One camera-space direction sample in 8 bytes: the unit direction,
+ * octahedral-encoded on two 16-bit signed integers (angular error below
+ * 1e-4 rad), and the exact distance from the camera.
+ */
+struct FDirectionSample
+{
+	int16 OctX;
+	int16 OctY;
+	float Length;
+
+	static FDirectionSample Encode(FVector const &Unit, float Length);
+	FVector DecodeUnit() const;
+};
+
+static_assert(sizeof(FDirectionSample) == 8, "Direction samples must stay at 8 bytes");
+
+/**
+ * Direction samples of a held object.  The buffer keeps its allocation when
+ * reset, so that grabbing again does not hit the allocator, and reports what
+ * it holds under "Persian Direction Samples" in stat memory.
+ */
+struct FDirectionSamples
+{
+	FDirectionSamples() = default;
+	~FDirectionSamples();
+	FDirectionSamples(FDirectionSamples const&) = delete;
+	FDirectionSamples& operator=(FDirectionSamples const&) = delete;
+
+	int32 Num() const { return this->Samples.Num(); }
+	FVector GetUnit(int32 i) const { return this->Samples[i].DecodeUnit(); }
+	float GetLength(int32 i) const { return this->Samples[i].Length; }
+	FVector Get(int32 i) const { return this->GetUnit(i) * this->GetLength(i); }
+	FDirectionSample* GetData() { return this->Samples.GetData(); }
+	FDirectionSample const* GetData() const { return this->Samples.GetData(); }
+
+	void Add(FVector const &d);
+	/* Grows the buffer by Count uninitialized samples and returns the index of the first one */
+	int32 AddUninitialized(int32 Count);
+	/* Keeps only the samples at Indices, which get sorted; sample order is preserved */
+	void Gather(TArray<int32> &Indices);
+	/* Drops every sample but keeps the allocation */
+	void Reset();
+	void Empty();
+
+private:
+	TArray<FDirectionSample> Samples;
+	SIZE_T TrackedBytes = 0;
+	void UpdateMemoryStat();
+};
+
+namespace PersianDirections
+{
+	/** Point-to-camera-space matrix: d = InvCamRotation * (ToWorld(p) - CamLocation) */
+	FMatrix MakeToCameraMatrix(FTransform const &ToWorld, FVector const &CamLocation, FQuat const &CamRotation);
+
+	/**
+	 * Appends NumPoints points, transformed by ToCamera, to Out.  Runs four
+	 * points per vector register and spreads large inputs over worker threads.
+	 */
+	void AppendTransformed(FDirectionSamples &Out, FVector const *Points, int32 NumPoints, FMatrix const &ToCamera);
+
+	/** Decodes every unit direction of In and rotates it by CamRotation into OutDirs (world space) */
+	void RotateToWorld(FDirectionSamples const &In, FQuat const &CamRotation, TArray<FVector> &OutDirs);
+}
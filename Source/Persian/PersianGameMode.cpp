@@ -1,17 +1,61 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "PersianGameMode.h"
+#include "Persian.h"
 #include "PersianHUD.h"
 #include "PersianCharacter.h"
-#include "UObject/ConstructorHelpers.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
 
 APersianGameMode::APersianGameMode()
 	: Super()
 {
-	// set default pawn class to our Blueprinted character
-	static ConstructorHelpers::FClassFinder<APawn> PlayerPawnClassFinder(TEXT("/Game/FirstPersonCPP/Blueprints/FirstPersonCharacter"));
-	DefaultPawnClass = PlayerPawnClassFinder.Class;
+	// set default pawn class to our Blueprinted character, loaded in InitGame
+	SoftDefaultPawnClass = TSoftClassPtr<APawn>(FSoftObjectPath(TEXT("/Game/FirstPersonCPP/Blueprints/FirstPersonCharacter.FirstPersonCharacter_C")));
+	// the native character if the blueprint cannot be loaded
+	DefaultPawnClass = APersianCharacter::StaticClass();
 
 	// use our custom HUD class
 	HUDClass = APersianHUD::StaticClass();
 }
+
+void APersianGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
+{
+	Super::InitGame(MapName, Options, ErrorMessage);
+	UE_LOG(LogPersianStartup, Log, TEXT("InitGame %s"), *MapName);
+	PersianStartup::Mark(TEXT("InitGame"));
+
+	if (SoftDefaultPawnClass.IsNull() || SoftDefaultPawnClass.Get() != nullptr)
+	{
+		return;
+	}
+	if (PersianStartup::SyncLoad())
+	{
+		// the baseline: blocks here, as the finder did when constructing this class
+		const double Start = FPlatformTime::Seconds();
+		SoftDefaultPawnClass.LoadSynchronous();
+		PersianStartup::AddBlocked(FPlatformTime::Seconds() - Start);
+		PersianStartup::Mark(TEXT("PawnClass"));
+		return;
+	}
+	// start loading the pawn while the level starts up, players are spawned later
+	PawnClassHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(SoftDefaultPawnClass.ToSoftObjectPath(),
+		FStreamableDelegate::CreateLambda([]() { PersianStartup::Mark(TEXT("PawnClass")); }));
+}
+
+UClass* APersianGameMode::GetDefaultPawnClassForController_Implementation(AController* InController)
+{
+	if (PawnClassHandle.IsValid() && !PawnClassHandle->HasLoadCompleted())
+	{
+		// only blocks if the first player arrives before the load is done
+		const double Start = FPlatformTime::Seconds();
+		PawnClassHandle->WaitUntilComplete();
+		PersianStartup::AddBlocked(FPlatformTime::Seconds() - Start);
+		UE_LOG(LogPersianStartup, Log, TEXT("Waited %.2f ms for %s"), (FPlatformTime::Seconds() - Start) * 1000, *SoftDefaultPawnClass.ToString());
+	}
+	if (UClass* PawnClass = SoftDefaultPawnClass.Get())
+	{
+		return PawnClass;
+	}
+	return Super::GetDefaultPawnClassForController_Implementation(InController);
+}
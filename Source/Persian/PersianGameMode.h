@@ -6,6 +6,8 @@
 #include "GameFramework/GameModeBase.h"
 #include "PersianGameMode.generated.h"
 
+struct FStreamableHandle;
+
 UCLASS(minimalapi)
 class APersianGameMode : public AGameModeBase
 {
@@ -13,6 +15,16 @@ class APersianGameMode : public AGameModeBase
 
 public:
 	APersianGameMode();
+
+	/** Pawn spawned for players, loaded once the game starts rather than along with this class */
+	UPROPERTY(EditDefaultsOnly, Category = Classes)
+	TSoftClassPtr<APawn> SoftDefaultPawnClass;
+
+	virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+	virtual UClass* GetDefaultPawnClassForController_Implementation(AController* InController) override;
+
+private:
+	TSharedPtr<FStreamableHandle> PawnClassHandle;
 };
 
 
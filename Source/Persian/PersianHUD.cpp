@@ -1,44 +1,96 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "PersianHUD.h"
+#include "Persian.h"
+#include "PersianAttachableRegistry.h"
+#include "PersianCharacter.h"
 #include "Engine/Canvas.h"
 #include "Engine/Texture2D.h"
 #include "TextureResource.h"
 #include "CanvasItem.h"
-#include "UObject/ConstructorHelpers.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
 
 APersianHUD::APersianHUD()
 {
-	// Set the crosshair texture
-	static ConstructorHelpers::FObjectFinder<UTexture2D>
-		CrosshairTexObj(TEXT("/Game/FirstPerson/Textures/FirstPersonCrosshair"));
-	// Set the thumbs up texture
-	static ConstructorHelpers::FObjectFinder<UTexture2D>
-		ThumbsUpObj(TEXT("/Game/FirstPerson/Textures/thumbsup"));
-	this->CrosshairTex = CrosshairTexObj.Object;
-	this->ThumbsUpTex = ThumbsUpObj.Object;
+	// Set the crosshair and thumbs up textures, loaded on BeginPlay
+	this->CrosshairAsset = TSoftObjectPtr<UTexture2D>(FSoftObjectPath(TEXT("/Game/FirstPerson/Textures/FirstPersonCrosshair.FirstPersonCrosshair")));
+	this->ThumbsUpAsset = TSoftObjectPtr<UTexture2D>(FSoftObjectPath(TEXT("/Game/FirstPerson/Textures/thumbsup.thumbsup")));
+	this->CrosshairTex = nullptr;
+	this->ThumbsUpTex = nullptr;
+	this->bMissionComplete = false;
+	this->bFirstFrameLogged = false;
 }
 
+void APersianHUD::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (PersianStartup::SyncLoad())
+	{
+		// the baseline: blocks here, as the finders did when constructing this class
+		const double Start = FPlatformTime::Seconds();
+		this->CrosshairAsset.LoadSynchronous();
+		this->ThumbsUpAsset.LoadSynchronous();
+		PersianStartup::AddBlocked(FPlatformTime::Seconds() - Start);
+		this->OnTexturesLoaded();
+		return;
+	}
+	TArray<FSoftObjectPath> Textures;
+	Textures.Add(this->CrosshairAsset.ToSoftObjectPath());
+	Textures.Add(this->ThumbsUpAsset.ToSoftObjectPath());
+	UAssetManager::GetStreamableManager().RequestAsyncLoad(Textures,
+		FStreamableDelegate::CreateUObject(this, &APersianHUD::OnTexturesLoaded));
+}
+
+void APersianHUD::OnTexturesLoaded()
+{
+	this->CrosshairTex = this->CrosshairAsset.Get();
+	this->ThumbsUpTex = this->ThumbsUpAsset.Get();
+	PersianStartup::Mark(TEXT("HUDTextures"));
+}
 
 void APersianHUD::DrawHUD()
 {
 	Super::DrawHUD();
 
+	if (!this->bFirstFrameLogged)
+	{
+		this->bFirstFrameLogged = true;
+		PersianStartup::Mark(TEXT("FirstFrame"));
+	}
+
+	// Nothing to draw until the textures are in
+	UTexture2D* const Tex = (this->bMissionComplete && this->ThumbsUpTex != nullptr) ? this->ThumbsUpTex : this->CrosshairTex;
+	if (Tex == nullptr)
+	{
+		return;
+	}
+
 	// Draw very simple crosshair
 
 	// find center of the Canvas
 	const FVector2D Center(Canvas->ClipX * 0.5f, Canvas->ClipY * 0.5f);
 
 	// offset by half the texture's dimensions so that the center of the texture aligns with the center of the Canvas
-	const FVector2D CrosshairDrawPosition(Center.X - this->CrosshairTex->GetSizeX() * 0.5,
-										  Center.Y - this->CrosshairTex->GetSizeY() * 0.5);
+	const FVector2D CrosshairDrawPosition(Center.X - Tex->GetSizeX() * 0.5,
+										  Center.Y - Tex->GetSizeY() * 0.5);
+
+	// tint it when what is under it can be grabbed, from the hover query shared with the character
+	FLinearColor Tint = FLinearColor::White;
+	APersianCharacter const* Character = Cast<APersianCharacter>(this->GetOwningPawn());
+	UPersianAttachableRegistry* Registry = this->GetWorld()->GetSubsystem<UPersianAttachableRegistry>();
+	if (Character != nullptr && Character->Attaching() == nullptr && Registry != nullptr
+		&& Registry->GetHover(Character->GetForcedPerspective()).bAttachable) {
+		Tint = FLinearColor(0.3f, 1.0f, 0.3f);
+	}
 
 	// draw the crosshair
-	FCanvasTileItem TileItem(CrosshairDrawPosition, CrosshairTex->Resource, FLinearColor::White);
+	FCanvasTileItem TileItem(CrosshairDrawPosition, Tex->Resource, Tint);
 	TileItem.BlendMode = SE_BLEND_Translucent;
 	Canvas->DrawItem(TileItem);
 }
 
 void APersianHUD::MissionComplete() {
-	this->CrosshairTex = this->ThumbsUpTex;
+	this->bMissionComplete = true;
 }
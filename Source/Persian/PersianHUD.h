@@ -6,6 +6,8 @@
 #include "GameFramework/HUD.h"
 #include "PersianHUD.generated.h"
 
+class UTexture2D;
+
 UCLASS()
 class APersianHUD : public AHUD
 {
@@ -17,15 +19,31 @@ class APersianHUD : public AHUD
 	/** Primary draw call for the HUD */
 	virtual void DrawHUD() override;
 
+	virtual void BeginPlay() override;
+
 	UFUNCTION(BlueprintCallable, Category = Persian)
 		void MissionComplete();
 
+	/** Crosshair asset, loaded asynchronously on BeginPlay */
+	UPROPERTY(EditDefaultsOnly, Category = Persian)
+	TSoftObjectPtr<UTexture2D> CrosshairAsset;
+
+	/** Thumbs up asset, loaded asynchronously on BeginPlay */
+	UPROPERTY(EditDefaultsOnly, Category = Persian)
+	TSoftObjectPtr<UTexture2D> ThumbsUpAsset;
+
 private:
-	/** Crosshair asset pointer */
-	class UTexture2D* CrosshairTex;
+	/** Crosshair asset pointer, null until loaded */
+	UPROPERTY(Transient)
+	UTexture2D* CrosshairTex;
+
+	/** Thumbs up asset pointer, null until loaded */
+	UPROPERTY(Transient)
+	UTexture2D* ThumbsUpTex;
 
-	/** Thumbs up asset pointer */
-	class UTexture2D* ThumbsUpTex;
+	bool bMissionComplete;
+	bool bFirstFrameLogged;
 
+	void OnTexturesLoaded();
 };
 
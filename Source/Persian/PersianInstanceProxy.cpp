@@ -0,0 +1,140 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianInstanceProxy.h"
+#include "Persian.h"
+#include "PersianAttachableRegistry.h"
+#include "ForcedPerspectiveComponent.h"
+#include "GameFramework/Pawn.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/World.h"
+#include "Net/UnrealNetwork.h"
+#include "TimerManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Instance promotion"), STAT_PersianPromoteInstance, STATGROUP_Persian);
+
+FName const APersianInstanceProxy::GrabbableTag(TEXT("Grabbable"));
+
+APersianInstanceProxy::APersianInstanceProxy() {
+	this->SettleTimeout = 5.0f;
+	this->Source = nullptr;
+	this->InstanceIndex = INDEX_NONE;
+	this->Holder = nullptr;
+	this->bInstanceHidden = false;
+
+	this->bReplicates = true;
+	this->bStaticMeshReplicateMovement = true;
+	this->SetReplicatingMovement(true);
+
+	UStaticMeshComponent* Mesh = this->GetStaticMeshComponent();
+	Mesh->SetMobility(EComponentMobility::Movable);
+	Mesh->SetCollisionProfileName(UCollisionProfile::PhysicsActor_ProfileName);
+	/* Settles on the first sleep event after the release */
+	Mesh->BodyInstance.bGenerateWakeEvents = true;
+	Mesh->OnComponentSleep.AddDynamic(this, &APersianInstanceProxy::OnMeshSleep);
+}
+
+UInstancedStaticMeshComponent* APersianInstanceProxy::GetGrabbableInstances(FHitResult const& Hit) {
+	UInstancedStaticMeshComponent* Instances = Cast<UInstancedStaticMeshComponent>(Hit.GetComponent());
+	if (Instances == nullptr || !Instances->ComponentHasTag(GrabbableTag) || !Instances->IsValidInstance(Hit.Item)) {
+		return nullptr;
+	}
+	return Instances;
+}
+
+APersianInstanceProxy* APersianInstanceProxy::Promote(UInstancedStaticMeshComponent* Instances, int32 Item,
+	UForcedPerspectiveComponent* InHolder, FVector const& InHitLocation) {
+	if (Instances == nullptr || Instances->GetStaticMesh() == nullptr || !Instances->IsValidInstance(Item)) {
+		return nullptr;
+	}
+	FTransform InstanceTransform;
+	Instances->GetInstanceTransform(Item, InstanceTransform, true);
+	if (InstanceTransform.GetScale3D().IsNearlyZero()) {
+		/* Hidden, already promoted */
+		return nullptr;
+	}
+	SCOPE_CYCLE_COUNTER(STAT_PersianPromoteInstance);
+	UWorld* const World = Instances->GetWorld();
+	APersianInstanceProxy* Proxy = World->SpawnActorDeferred<APersianInstanceProxy>(APersianInstanceProxy::StaticClass(),
+		InstanceTransform, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	if (Proxy == nullptr) {
+		return nullptr;
+	}
+	Proxy->Source = Instances;
+	Proxy->InstanceIndex = Item;
+	Proxy->Holder = InHolder;
+	Proxy->HitLocation = InHitLocation;
+	UStaticMeshComponent* Mesh = Proxy->GetStaticMeshComponent();
+	Mesh->SetStaticMesh(Instances->GetStaticMesh());
+	for (int32 i = 0; i < Instances->GetNumMaterials(); ++i) {
+		Mesh->SetMaterial(i, Instances->GetMaterial(i));
+	}
+	Proxy->FinishSpawning(InstanceTransform);
+	/* Registered on spawn, before it had a mesh */
+	if (UPersianAttachableRegistry* Registry = World->GetSubsystem<UPersianAttachableRegistry>()) {
+		Registry->Unregister(Proxy);
+	}
+	return Proxy;
+}
+
+void APersianInstanceProxy::BeginPlay() {
+	Super::BeginPlay();
+	this->HideInstance();
+	APawn const* HolderPawn = this->Holder != nullptr ? Cast<APawn>(this->Holder->GetOwner()) : nullptr;
+	if (!this->HasAuthority() && HolderPawn != nullptr && HolderPawn->IsLocallyControlled()
+		&& this->Holder->Attaching() == nullptr) {
+		/* The server grabbed it for this client */
+		this->Holder->GrabObject(this, this->HitLocation);
+	}
+}
+
+void APersianInstanceProxy::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+	if (this->bInstanceHidden && IsValid(this->Source) && this->Source->IsValidInstance(this->InstanceIndex)) {
+		/* The instance takes over where the proxy ended up */
+		this->Source->UpdateInstanceTransform(this->InstanceIndex, this->GetActorTransform(), true, true, true);
+	}
+	this->bInstanceHidden = false;
+	this->GetWorldTimerManager().ClearTimer(this->SettleTimer);
+	Super::EndPlay(EndPlayReason);
+}
+
+void APersianInstanceProxy::HideInstance() {
+	if (this->bInstanceHidden || this->Source == nullptr || !this->Source->IsValidInstance(this->InstanceIndex)) {
+		return;
+	}
+	/* Zero scale rather than removal, which would renumber the other instances */
+	FTransform Hidden;
+	this->Source->GetInstanceTransform(this->InstanceIndex, Hidden, true);
+	Hidden.SetScale3D(FVector::ZeroVector);
+	this->Source->UpdateInstanceTransform(this->InstanceIndex, Hidden, true, true, true);
+	this->bInstanceHidden = true;
+}
+
+void APersianInstanceProxy::Settle() {
+	if (this->HasAuthority()) {
+		this->GetWorldTimerManager().SetTimer(this->SettleTimer, this, &APersianInstanceProxy::Retire,
+			FMath::Max(this->SettleTimeout, 0.01f), false);
+	}
+}
+
+void APersianInstanceProxy::Retire() {
+	/* Collision is off while a character holds it */
+	if (this->HasAuthority() && this->GetActorEnableCollision() && !this->IsPendingKillPending()) {
+		this->Destroy();
+	}
+}
+
+void APersianInstanceProxy::OnMeshSleep(UPrimitiveComponent* SleepingComponent, FName BoneName) {
+	if (this->GetWorldTimerManager().IsTimerActive(this->SettleTimer)) {
+		this->Retire();
+	}
+}
+
+void APersianInstanceProxy::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const {
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(APersianInstanceProxy, Source, COND_InitialOnly);
+	DOREPLIFETIME_CONDITION(APersianInstanceProxy, InstanceIndex, COND_InitialOnly);
+	DOREPLIFETIME_CONDITION(APersianInstanceProxy, Holder, COND_InitialOnly);
+	DOREPLIFETIME_CONDITION(APersianInstanceProxy, HitLocation, COND_InitialOnly);
+}
@@ -0,0 +1,70 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/StaticMeshActor.h"
+#include "PersianInstanceProxy.generated.h"
+
+class UForcedPerspectiveComponent;
+class UInstancedStaticMeshComponent;
+
+/**
+ * Stand-in for one instance of an instanced static mesh component while it
+ * is held or falling.  Promoting an instance hides it, by zero scale so that
+ * the indices of the other instances stay put, and spawns this actor in its
+ * place; when the actor goes away its transform is written back to the
+ * instance.  Once released the proxy lives until its body falls asleep, or
+ * SettleTimeout at most.
+ *
+ * Only instances of components tagged GrabbableTag can be promoted, so that
+ * static batches such as walls and floors are left alone.
+ */
+UCLASS()
+class PERSIAN_API APersianInstanceProxy : public AStaticMeshActor
+{
+	GENERATED_BODY()
+
+public:
+	APersianInstanceProxy();
+
+	/** Component tag that makes the instances of an instanced static mesh component grabbable */
+	static FName const GrabbableTag;
+
+	/** Instanced component of Hit when the hit instance can be grabbed, else null */
+	static UInstancedStaticMeshComponent* GetGrabbableInstances(FHitResult const& Hit);
+
+	/** Server: hides instance Item of Instances and spawns a proxy in its place, InHolder grabs it at InHitLocation */
+	static APersianInstanceProxy* Promote(UInstancedStaticMeshComponent* Instances, int32 Item,
+		UForcedPerspectiveComponent* InHolder, FVector const& InHitLocation);
+
+	/** Seconds a released proxy waits for its body to sleep before handing back to the instance */
+	UPROPERTY(EditDefaultsOnly, Category = Persian)
+	float SettleTimeout;
+
+	/** Server: hands back to the instance once the proxy comes to rest, unless it is grabbed again */
+	void Settle();
+
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+private:
+	UPROPERTY(Replicated)
+	UInstancedStaticMeshComponent* Source;
+	UPROPERTY(Replicated)
+	int32 InstanceIndex;
+	/* Who promoted the instance, its owning client grabs the proxy as soon as it shows up */
+	UPROPERTY(Replicated)
+	UForcedPerspectiveComponent* Holder;
+	UPROPERTY(Replicated)
+	FVector_NetQuantize HitLocation;
+
+	FTimerHandle SettleTimer;
+	bool bInstanceHidden;
+
+	void HideInstance();
+	void Retire();
+	UFUNCTION()
+	void OnMeshSleep(UPrimitiveComponent* SleepingComponent, FName BoneName);
+};
@@ -0,0 +1,232 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianPlacementSubsystem.h"
+#include "Persian.h"
+#include "ForcedPerspectiveComponent.h"
+#include "PersianCollision.h"
+#include "PersianDirections.h"
+#include "PersianStaticScene.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Physics/PhysicsInterfaceCore.h"
+
+#include <limits>
+
+DECLARE_CYCLE_STAT(TEXT("Batched placement flush"), STAT_PersianPlacementFlush, STATGROUP_Persian);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Batched placement requests"), STAT_PersianBatchedRequests, STATGROUP_Persian);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Batched placement rays"), STAT_PersianBatchedRays, STATGROUP_Persian);
+
+static TAutoConsoleVariable<int32> CVarPlacementChunkSize(
+	TEXT("persian.ParallelPlacement.ChunkSize"),
+	64,
+	TEXT("Number of placement rays traced by one worker task."),
+	ECVF_Default);
+
+//////////////////////////////////////////////////////////////////////////
+// PersianPlacement
+
+namespace PersianPlacement
+{
+
+double HitScale(float Distance, float Length, double const &Far) {
+	double scale = Far / Length;
+	if (Distance >= 0) {
+		scale = FMath::Min<double>(scale, (Distance - 1) / Length);
+	}
+	return scale;
+}
+
+double TraceSampleScale(UWorld* World, FVector const &CamLocation, FVector const &Dir, float Length,
+	double const &Far, FCollisionQueryParams const &QueryParams) {
+	FHitResult hitres;
+	World->LineTraceSingleByChannel(
+		hitres, CamLocation, CamLocation + Dir * Far,
+		PersianCollision::GetQueryChannel(),
+		QueryParams
+	);
+	// DrawDebugLine(World, CamLocation, hitres.Location, FColor::Yellow, false, 5);
+	return HitScale(hitres.bBlockingHit && !hitres.bStartPenetrating ? hitres.Distance : -1, Length, Far);
+}
+
+int32 GetRayChunkSize() {
+	return FMath::Max(1, CVarPlacementChunkSize.GetValueOnGameThread());
+}
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FPlacementFlushTickFunction
+
+void FPlacementFlushTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread,
+	const FGraphEventRef& MyCompletionGraphEvent) {
+	if (this->Target != nullptr && TickType != LEVELTICK_ViewportsOnly) {
+		this->Target->FlushPlacements();
+	}
+}
+
+FString FPlacementFlushTickFunction::DiagnosticMessage() {
+	return TEXT("UPersianPlacementSubsystem[FlushPlacements]");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UPersianPlacementSubsystem
+
+UPersianPlacementSubsystem::UPersianPlacementSubsystem()
+{
+	/* Same group as the held object ticks, after the camera update, and ahead of them, see AddFlushPrerequisite */
+	this->FlushTick.bCanEverTick = true;
+	this->FlushTick.bStartWithTickEnabled = true;
+	this->FlushTick.TickGroup = TG_PostUpdateWork;
+	this->FlushTick.Target = this;
+	this->FlushSeconds = 0;
+}
+
+void UPersianPlacementSubsystem::RequestPlacement(UForcedPerspectiveComponent* Holder, double Far, TFunction<void(double)> OnSolved) {
+	check(IsInGameThread());
+	if (Holder == nullptr) {
+		return;
+	}
+	this->RegisterFlushTick();
+	this->Pending.Add(FPendingPlacement{ Holder, Far, MoveTemp(OnSolved) });
+}
+
+void UPersianPlacementSubsystem::AddFlushPrerequisite(FTickFunction& TickFunction) {
+	this->RegisterFlushTick();
+	if (this->FlushTick.IsTickFunctionRegistered()) {
+		TickFunction.AddPrerequisite(this, this->FlushTick);
+	}
+}
+
+void UPersianPlacementSubsystem::RegisterFlushTick() {
+	if (!this->FlushTick.IsTickFunctionRegistered() && this->GetWorld()->PersistentLevel != nullptr) {
+		this->FlushTick.Target = this;
+		this->FlushTick.RegisterTickFunction(this->GetWorld()->PersistentLevel);
+	}
+}
+
+void UPersianPlacementSubsystem::CancelPlacement(UForcedPerspectiveComponent const* Holder) {
+	this->Pending.RemoveAll([Holder](FPendingPlacement const& Request) {
+		return Request.Holder.Get() == Holder;
+	});
+}
+
+bool UPersianPlacementSubsystem::IsPlacementPending(UForcedPerspectiveComponent const* Holder) const {
+	return this->Pending.ContainsByPredicate([Holder](FPendingPlacement const& Request) {
+		return Request.Holder.Get() == Holder;
+	});
+}
+
+void UPersianPlacementSubsystem::FlushPlacements() {
+	check(IsInGameThread());
+	if (this->Pending.Num() == 0) {
+		return;
+	}
+	PERSIAN_SCOPED_TIMING(PlacementFlush);
+	double const FlushStart = FPlatformTime::Seconds();
+	/* Callbacks may queue again, those wait for the next flush */
+	TArray<FPendingPlacement> Requests = MoveTemp(this->Pending);
+	this->Pending.Reset();
+
+	/* Rays of every request in one flat list, each request owning the range [First, First + Num) */
+	struct FRequestRays
+	{
+		FVector CamLocation;
+		FCollisionQueryParams QueryParams;
+		double Far;
+		int32 First;
+		int32 Num;
+		/* Points to QueryParams, Batches never grows past its reserve */
+		FStaticRayQuery Query;
+	};
+	UWorld* const World = this->GetWorld();
+	UPersianStaticScene const* const Scene = UPersianStaticScene::GetForQueries(World);
+	TArray<FRequestRays> Batches;
+	Batches.Reserve(Requests.Num());
+	TArray<FVector> Dirs;
+	TArray<float> Lengths;
+	TArray<int32> Owners;
+	TArray<FVector> HolderDirs;
+	for (FPendingPlacement const& Request : Requests) {
+		UForcedPerspectiveComponent const* Holder = Request.Holder.Get();
+		FRequestRays& Batch = Batches.AddDefaulted_GetRef();
+		Batch.First = Dirs.Num();
+		Batch.Num = 0;
+		Batch.Far = Request.Far;
+		if (Holder == nullptr || Holder->Attaching() == nullptr) {
+			continue;
+		}
+		FDirectionSamples const& Samples = Holder->GetDirections();
+		FTransform const View = Holder->GetViewTransform();
+		Batch.CamLocation = View.GetLocation();
+		Batch.QueryParams = Holder->GetPlacementQueryParams();
+		Batch.Num = Samples.Num();
+		PersianDirections::RotateToWorld(Samples, View.GetRotation(), HolderDirs);
+		Dirs.Append(HolderDirs);
+		if (Scene != nullptr) {
+			Scene->PrepareRays(Batch.Query, Batch.CamLocation, HolderDirs.GetData(), HolderDirs.Num(), float(Batch.Far), Batch.QueryParams);
+		}
+		for (int32 i = 0; i < Samples.Num(); ++i) {
+			Lengths.Add(Samples.GetLength(i));
+			Owners.Add(Batches.Num() - 1);
+		}
+	}
+	INC_DWORD_STAT_BY(STAT_PersianBatchedRequests, Requests.Num());
+	INC_DWORD_STAT_BY(STAT_PersianBatchedRays, Dirs.Num());
+	CSV_CUSTOM_STAT(Persian, BatchedPlacementRays, Dirs.Num(), ECsvCustomStatOp::Accumulate);
+
+	/* One dispatch for all holders, chunks freely straddle requests */
+	TArray<double> Scales;
+	Scales.SetNumUninitialized(Dirs.Num());
+	TArray<float> Distances;
+	Distances.SetNumUninitialized(Scene != nullptr ? Dirs.Num() : 0);
+	int32 const ChunkSize = PersianPlacement::GetRayChunkSize();
+	int32 const NumChunks = FMath::DivideAndRoundUp(Dirs.Num(), ChunkSize);
+	FPhysicsCommand::ExecuteRead(World->GetPhysicsScene(), [&]() {
+		ParallelFor(NumChunks, [&](int32 Chunk) {
+			int32 const End = FMath::Min(Dirs.Num(), (Chunk + 1) * ChunkSize);
+			for (int32 i = Chunk * ChunkSize; i < End; ) {
+				FRequestRays const& Batch = Batches[Owners[i]];
+				if (Scene == nullptr) {
+					Scales[i] = PersianPlacement::TraceSampleScale(World, Batch.CamLocation, Dirs[i], Lengths[i],
+						Batch.Far, Batch.QueryParams);
+					++i;
+					continue;
+				}
+				/* The rays of the chunk that belong to this request, in one bulk query */
+				int32 const RunEnd = FMath::Min(End, Batch.First + Batch.Num);
+				Scene->RayCast(Batch.Query, i - Batch.First, &Dirs[i], RunEnd - i, &Distances[i]);
+				for (; i < RunEnd; ++i) {
+					Scales[i] = PersianPlacement::HitScale(Distances[i], Lengths[i], Batch.Far);
+				}
+			}
+		}, NumChunks < 2);
+	});
+
+	for (int32 r = 0; r < Requests.Num(); ++r) {
+		FRequestRays const& Batch = Batches[r];
+		UForcedPerspectiveComponent const* Holder = Requests[r].Holder.Get();
+		if (Holder == nullptr) {
+			continue;
+		}
+		if (Batch.Num == 0) {
+			/* Nothing to trace, the holder still waits for an answer: the scale the object is shown at */
+			Requests[r].OnSolved(Holder->GetHeldScale());
+			continue;
+		}
+		double minScale = std::numeric_limits<double>::max();
+		for (int32 i = Batch.First; i < Batch.First + Batch.Num; ++i) {
+			minScale = FMath::Min(minScale, Scales[i]);
+		}
+		Requests[r].OnSolved(minScale);
+	}
+	this->FlushSeconds += FPlatformTime::Seconds() - FlushStart;
+}
+
+void UPersianPlacementSubsystem::Deinitialize() {
+	this->Pending.Empty();
+	if (this->FlushTick.IsTickFunctionRegistered()) {
+		this->FlushTick.UnRegisterTickFunction();
+	}
+	Super::Deinitialize();
+}
@@ -0,0 +1,97 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PersianPlacementSubsystem.generated.h"
+
+class UForcedPerspectiveComponent;
+class UPersianPlacementSubsystem;
+
+/** Shared pieces of the ray placement solve */
+namespace PersianPlacement
+{
+	/** Largest scale for a sample at distance Length along a ray whose first blocking hit is at Distance, negative when none */
+	double HitScale(float Distance, float Length, double const &Far);
+
+	/** Largest scale at which a sample at distance Length along world direction Dir still fits in front of the scene */
+	double TraceSampleScale(UWorld* World, FVector const &CamLocation, FVector const &Dir, float Length,
+		double const &Far, FCollisionQueryParams const &QueryParams);
+
+	/** Number of placement rays traced by one worker task, see persian.ParallelPlacement.ChunkSize */
+	int32 GetRayChunkSize();
+}
+
+/** Solves the queued placements once the camera manager has updated the view for the frame */
+USTRUCT()
+struct FPlacementFlushTickFunction : public FTickFunction {
+	GENERATED_USTRUCT_BODY()
+
+	UPersianPlacementSubsystem* Target;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread,
+		const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FPlacementFlushTickFunction> : public TStructOpsTypeTraitsBase2<FPlacementFlushTickFunction> {
+	enum {
+		WithCopy = false
+	};
+};
+
+/**
+ * Collects the ray placement solves requested by every holder of the world
+ * during a frame and traces all their rays in one parallel pass, so that
+ * split-screen players and scripted holders share a single dispatch.
+ */
+UCLASS()
+class UPersianPlacementSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UPersianPlacementSubsystem();
+
+	/**
+	 * Queues a solve of the object held by Holder.  OnSolved gets the largest
+	 * placement scale when the queue is flushed, or the scale the object is
+	 * shown at when there are no samples to trace, unless the request is
+	 * cancelled or the holder destroyed first.
+	 */
+	void RequestPlacement(UForcedPerspectiveComponent* Holder, double Far, TFunction<void(double)> OnSolved);
+	/** Drops the queued requests of Holder */
+	void CancelPlacement(UForcedPerspectiveComponent const* Holder);
+	bool IsPlacementPending(UForcedPerspectiveComponent const* Holder) const;
+	int32 NumPendingPlacements() const { return this->Pending.Num(); }
+
+	/**
+	 * Makes TickFunction wait for the flush of every frame, so that the
+	 * game-thread callbacks of the flush never run alongside it
+	 */
+	void AddFlushPrerequisite(FTickFunction& TickFunction);
+
+	/** Solves every queued request now.  Game thread only */
+	void FlushPlacements();
+	/** Wall time spent in FlushPlacements since the world started, in seconds */
+	double GetFlushSeconds() const { return this->FlushSeconds; }
+
+	virtual void Deinitialize() override;
+
+private:
+	struct FPendingPlacement
+	{
+		TWeakObjectPtr<UForcedPerspectiveComponent> Holder;
+		double Far;
+		TFunction<void(double)> OnSolved;
+	};
+	TArray<FPendingPlacement> Pending;
+	double FlushSeconds;
+
+	FPlacementFlushTickFunction FlushTick;
+	/* The persistent level is not there yet when subsystems initialize, registers on first use */
+	void RegisterFlushTick();
+};
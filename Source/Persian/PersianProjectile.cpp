@@ -1,6 +1,7 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "PersianProjectile.h"
+#include "PersianProjectilePool.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
 
@@ -38,6 +39,45 @@ void APersianProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor,
 	{
 		OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
 
+		Retire();
+	}
+}
+
+void APersianProjectile::Launch(FTransform const& Transform)
+{
+	SetActorLocationAndRotation(Transform.GetLocation(), Transform.GetRotation(), false, nullptr, ETeleportType::ResetPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+
+	// Movement stops simulating on some hits, set it back up from scratch
+	ProjectileMovement->SetUpdatedComponent(CollisionComp);
+	ProjectileMovement->Velocity = Transform.GetRotation().GetForwardVector() * ProjectileMovement->InitialSpeed;
+	ProjectileMovement->UpdateComponentVelocity();
+	ProjectileMovement->SetComponentTickEnabled(true);
+
+	if (InitialLifeSpan > 0.0f)
+	{
+		GetWorldTimerManager().SetTimer(LifeSpanTimer, this, &APersianProjectile::Retire, InitialLifeSpan);
+	}
+}
+
+void APersianProjectile::Park()
+{
+	GetWorldTimerManager().ClearTimer(LifeSpanTimer);
+	ProjectileMovement->StopMovementImmediately();
+	ProjectileMovement->SetComponentTickEnabled(false);
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
+}
+
+void APersianProjectile::Retire()
+{
+	if (UPersianProjectilePool* Owner = Pool.Get())
+	{
+		Owner->Release(this);
+	}
+	else
+	{
 		Destroy();
 	}
 }
\ No newline at end of file
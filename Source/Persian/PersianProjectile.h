@@ -8,6 +8,7 @@
 
 class USphereComponent;
 class UProjectileMovementComponent;
+class UPersianProjectilePool;
 
 UCLASS(config=Game)
 class APersianProjectile : public AActor
@@ -33,5 +34,17 @@ class APersianProjectile : public AActor
 	USphereComponent* GetCollisionComp() const { return CollisionComp; }
 	/** Returns ProjectileMovement subobject **/
 	UProjectileMovementComponent* GetProjectileMovement() const { return ProjectileMovement; }
+
+	/** Pool this projectile goes back to instead of being destroyed, unset for spawned ones */
+	TWeakObjectPtr<UPersianProjectilePool> Pool;
+	/** Puts a pooled projectile in flight from Transform at its initial speed, for InitialLifeSpan */
+	void Launch(FTransform const& Transform);
+	/** Stops, hides and disables a pooled projectile */
+	void Park();
+	/** Returns to the pool, or is destroyed when not pooled */
+	void Retire();
+
+private:
+	FTimerHandle LifeSpanTimer;
 };
 
@@ -0,0 +1,185 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianProjectileManager.h"
+#include "Persian.h"
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "UObject/ConstructorHelpers.h"
+
+DECLARE_CYCLE_STAT(TEXT("Projectile simulation"), STAT_PersianProjectileSimulate, STATGROUP_Persian);
+DECLARE_CYCLE_STAT(TEXT("Projectile instances"), STAT_PersianProjectileInstances, STATGROUP_Persian);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Managed projectiles"), STAT_PersianManagedProjectiles, STATGROUP_Persian);
+
+static TAutoConsoleVariable<int32> CVarProjectileManager(
+	TEXT("persian.ProjectileManager"),
+	0,
+	TEXT("Simulate fired projectiles in bulk in an APersianProjectileManager rather than as actors."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarProjectileChunkSize(
+	TEXT("persian.ProjectileManager.ChunkSize"),
+	128,
+	TEXT("Number of projectiles swept by one worker task."),
+	ECVF_Default);
+
+APersianProjectileManager::APersianProjectileManager()
+{
+	PrimaryActorTick.bCanEverTick = true;
+
+	Instances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("Instances"));
+	Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Instances->CastShadow = false;
+	Instances->SetMobility(EComponentMobility::Movable);
+	RootComponent = Instances;
+
+	static ConstructorHelpers::FObjectFinder<UStaticMesh> SphereMesh(TEXT("/Engine/BasicShapes/Sphere"));
+	Instances->SetStaticMesh(SphereMesh.Object);
+
+	// Same defaults as APersianProjectile and its movement component
+	Radius = 5.0f;
+	LifeSpan = 3.0f;
+	GravityScale = 1.0f;
+	Bounciness = 0.6f;
+	Friction = 0.2f;
+	StopSpeed = 5.0f;
+	MaxProjectiles = 16384;
+	CollisionChannel = ECC_WorldDynamic;
+}
+
+APersianProjectileManager* APersianProjectileManager::Get(UWorld* World) {
+	if (World == nullptr) {
+		return nullptr;
+	}
+	for (TActorIterator<APersianProjectileManager> It(World); It; ++It) {
+		return *It;
+	}
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+	/* At the origin, so that instance space is world space */
+	return World->SpawnActor<APersianProjectileManager>(FVector::ZeroVector, FRotator::ZeroRotator, SpawnParams);
+}
+
+bool APersianProjectileManager::IsEnabled() {
+	return CVarProjectileManager.GetValueOnGameThread() != 0;
+}
+
+void APersianProjectileManager::Fire(FTransform const& Transform, float Speed) {
+	if (this->Positions.Num() >= FMath::Max(1, this->MaxProjectiles)) {
+		/* Make room; after swap removals slot 0 is only roughly the oldest, good enough when saturated */
+		this->RemoveProjectile(0);
+	}
+	this->Positions.Add(Transform.GetLocation());
+	this->Velocities.Add(Transform.GetRotation().GetForwardVector() * Speed);
+	this->Ages.Add(0);
+	INC_DWORD_STAT(STAT_PersianManagedProjectiles);
+}
+
+void APersianProjectileManager::RemoveProjectile(int32 Index) {
+	this->Positions.RemoveAtSwap(Index, 1, false);
+	this->Velocities.RemoveAtSwap(Index, 1, false);
+	this->Ages.RemoveAtSwap(Index, 1, false);
+	DEC_DWORD_STAT(STAT_PersianManagedProjectiles);
+}
+
+void APersianProjectileManager::Clear() {
+	DEC_DWORD_STAT_BY(STAT_PersianManagedProjectiles, this->Positions.Num());
+	this->Positions.Reset();
+	this->Velocities.Reset();
+	this->Ages.Reset();
+	this->UpdateInstances();
+}
+
+void APersianProjectileManager::Tick(float DeltaTime) {
+	Super::Tick(DeltaTime);
+	this->Simulate(DeltaTime);
+}
+
+void APersianProjectileManager::Simulate(float DeltaTime) {
+	PERSIAN_SCOPED_TIMING(ProjectileSimulate);
+	int32 const Count = this->Positions.Num();
+	if (Count > 0) {
+		UWorld* const World = this->GetWorld();
+		FVector const Gravity(0, 0, World->GetGravityZ() * this->GravityScale);
+		FCollisionQueryParams const QueryParams(SCENE_QUERY_STAT(PersianProjectiles), false, this);
+		FCollisionShape const Sphere = FCollisionShape::MakeSphere(this->Radius);
+		ECollisionChannel const Channel = this->CollisionChannel;
+		this->HitFlags.SetNumUninitialized(Count);
+		this->HitResults.SetNum(Count, false);
+
+		/* Integrate and sweep, every projectile on its own */
+		int32 const ChunkSize = FMath::Max(1, CVarProjectileChunkSize.GetValueOnGameThread());
+		int32 const NumChunks = FMath::DivideAndRoundUp(Count, ChunkSize);
+		FPhysicsCommand::ExecuteRead(World->GetPhysicsScene(), [&]() {
+			ParallelFor(NumChunks, [&](int32 Chunk) {
+				int32 const End = FMath::Min(Count, (Chunk + 1) * ChunkSize);
+				for (int32 i = Chunk * ChunkSize; i < End; ++i) {
+					this->Ages[i] += DeltaTime;
+					this->Velocities[i] += Gravity * DeltaTime;
+					FVector const Target = this->Positions[i] + this->Velocities[i] * DeltaTime;
+					this->HitFlags[i] = World->SweepSingleByChannel(this->HitResults[i], this->Positions[i], Target,
+						FQuat::Identity, Channel, Sphere, QueryParams);
+					this->Positions[i] = this->HitFlags[i] ? this->HitResults[i].Location : Target;
+				}
+			}, NumChunks < 2);
+		});
+
+		/* Hit responses touch other objects, so they stay on the game thread.
+		 * Going backwards, a removal only swaps in a projectile already handled. */
+		for (int32 i = Count - 1; i >= 0; --i) {
+			bool bDead = this->Ages[i] >= this->LifeSpan;
+			if (!bDead && this->HitFlags[i]) {
+				FHitResult const& Hit = this->HitResults[i];
+				UPrimitiveComponent* Other = Hit.GetComponent();
+				if (Other != nullptr && Other->IsSimulatingPhysics()) {
+					/* As APersianProjectile::OnHit */
+					Other->AddImpulseAtLocation(this->Velocities[i] * 100.0f, this->Positions[i]);
+					bDead = true;
+				} else {
+					/* As UProjectileMovementComponent::ComputeBounceDelta */
+					FVector const Normal = Hit.Normal;
+					FVector const Projected = Normal * -FVector::DotProduct(this->Velocities[i], Normal);
+					FVector const Tangent = this->Velocities[i] + Projected;
+					this->Velocities[i] = Tangent * FMath::Clamp(1.0f - this->Friction, 0.0f, 1.0f) + Projected * this->Bounciness;
+					this->Positions[i] += Normal * 0.1f;
+					bDead = this->Velocities[i].SizeSquared() < FMath::Square(this->StopSpeed);
+				}
+			}
+			if (bDead) {
+				this->RemoveProjectile(i);
+			}
+		}
+	}
+	this->UpdateInstances();
+}
+
+void APersianProjectileManager::UpdateInstances() {
+	SCOPE_CYCLE_COUNTER(STAT_PersianProjectileInstances);
+	int32 const Count = this->Positions.Num();
+	FVector const Scale(this->Radius / 50.0f);
+	this->InstanceTransforms.SetNumUninitialized(Count);
+	for (int32 i = 0; i < Count; ++i) {
+		this->InstanceTransforms[i] = FTransform(FQuat::Identity, this->Positions[i], Scale);
+	}
+
+	int32 const Existing = this->Instances->GetInstanceCount();
+	if (Existing > Count) {
+		TArray<int32> Extra;
+		for (int32 i = Count; i < Existing; ++i) {
+			Extra.Add(i);
+		}
+		this->Instances->RemoveInstances(Extra);
+	} else if (Existing < Count) {
+		TArray<FTransform> Added(this->InstanceTransforms.GetData() + Existing, Count - Existing);
+		this->Instances->AddInstances(Added, false);
+	}
+	if (Count > 0) {
+		/* One render update for every instance */
+		this->Instances->BatchUpdateInstancesTransforms(0, this->InstanceTransforms, false, true, true);
+	}
+}
@@ -0,0 +1,91 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "PersianProjectileManager.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+
+/**
+ * Simulates plain projectiles without an actor each: their state lives in
+ * flat arrays, they are swept and integrated in parallel, and drawn as the
+ * instances of a single component.  Hits bounce like APersianProjectile and
+ * push simulating bodies the same way, which also ends the projectile.
+ *
+ * Used by UPersianProjectilePool::SpawnProjectile when persian.ProjectileManager
+ * is set; one is spawned on demand per world.
+ */
+UCLASS(config=Game)
+class APersianProjectileManager : public AActor
+{
+	GENERATED_BODY()
+
+	/** One instance per projectile in flight */
+	UPROPERTY(VisibleAnywhere, Category = Projectile)
+	UInstancedStaticMeshComponent* Instances;
+
+public:
+	APersianProjectileManager();
+
+	/** Manager of World, spawned if there is none yet */
+	static APersianProjectileManager* Get(UWorld* World);
+	/** Whether SpawnProjectile should go through the manager, see persian.ProjectileManager */
+	static bool IsEnabled();
+
+	/** Collision radius of the projectiles */
+	UPROPERTY(EditAnywhere, Category = Projectile)
+	float Radius;
+
+	/** Seconds a projectile stays in flight */
+	UPROPERTY(EditAnywhere, Category = Projectile)
+	float LifeSpan;
+
+	UPROPERTY(EditAnywhere, Category = Projectile)
+	float GravityScale;
+
+	/** Share of the speed along the normal kept on a bounce */
+	UPROPERTY(EditAnywhere, Category = Projectile)
+	float Bounciness;
+
+	/** Share of the speed along the surface lost on a bounce */
+	UPROPERTY(EditAnywhere, Category = Projectile)
+	float Friction;
+
+	/** Projectiles slower than this after a bounce are dropped */
+	UPROPERTY(EditAnywhere, Category = Projectile)
+	float StopSpeed;
+
+	/** Most projectiles in flight, firing past it drops the oldest */
+	UPROPERTY(EditAnywhere, Category = Projectile)
+	int32 MaxProjectiles;
+
+	UPROPERTY(EditAnywhere, Category = Projectile)
+	TEnumAsByte<ECollisionChannel> CollisionChannel;
+
+	/** Launches a projectile from Transform at Speed */
+	void Fire(FTransform const& Transform, float Speed);
+	/** Advances every projectile by DeltaTime and redraws them */
+	void Simulate(float DeltaTime);
+	/** Drops every projectile */
+	void Clear();
+	int32 Num() const { return this->Positions.Num(); }
+
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	/* Structure of arrays, index i being one projectile */
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<float> Ages;
+
+	/* Per-frame scratch */
+	TArray<uint8> HitFlags;
+	TArray<FHitResult> HitResults;
+	TArray<FTransform> InstanceTransforms;
+
+	void RemoveProjectile(int32 Index);
+	void UpdateInstances();
+};
@@ -0,0 +1,142 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianProjectilePool.h"
+#include "Persian.h"
+#include "PersianProjectile.h"
+#include "PersianProjectileManager.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Projectile acquire"), STAT_PersianProjectileAcquire, STATGROUP_Persian);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectiles in flight"), STAT_PersianProjectilesActive, STATGROUP_Persian);
+
+static TAutoConsoleVariable<int32> CVarProjectilePool(
+	TEXT("persian.ProjectilePool"),
+	1,
+	TEXT("Recycle projectiles instead of spawning and destroying one per shot."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarProjectilePoolCap(
+	TEXT("persian.ProjectilePool.Cap"),
+	256,
+	TEXT("Most projectiles of one class alive at once, parked ones included."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarProjectilePoolPrewarm(
+	TEXT("persian.ProjectilePool.Prewarm"),
+	32,
+	TEXT("Projectiles spawned ahead of the first shot of every character."),
+	ECVF_Default);
+
+APersianProjectile* UPersianProjectilePool::SpawnProjectile(UWorld* World, TSubclassOf<APersianProjectile> Class,
+	FTransform const& Transform) {
+	if (World == nullptr || Class == nullptr) {
+		return nullptr;
+	}
+	if (APersianProjectileManager::IsEnabled()) {
+		/* No actor at all, the manager only needs the launch speed */
+		if (APersianProjectileManager* Manager = APersianProjectileManager::Get(World)) {
+			Manager->Fire(Transform, Class.GetDefaultObject()->GetProjectileMovement()->InitialSpeed);
+			return nullptr;
+		}
+	}
+	if (CVarProjectilePool.GetValueOnGameThread() != 0) {
+		if (UPersianProjectilePool* Pool = World->GetSubsystem<UPersianProjectilePool>()) {
+			return Pool->Acquire(Class, Transform);
+		}
+	}
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+	return World->SpawnActor<APersianProjectile>(Class, Transform, SpawnParams);
+}
+
+APersianProjectile* UPersianProjectilePool::SpawnParked(UClass* Class) {
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	APersianProjectile* Projectile = this->GetWorld()->SpawnActor<APersianProjectile>(Class, FTransform::Identity, SpawnParams);
+	if (Projectile != nullptr) {
+		/* The pool takes care of the life span */
+		Projectile->SetLifeSpan(0);
+		Projectile->Pool = this;
+		Projectile->Park();
+	}
+	return Projectile;
+}
+
+APersianProjectile* UPersianProjectilePool::Acquire(TSubclassOf<APersianProjectile> Class, FTransform const& Transform) {
+	SCOPE_CYCLE_COUNTER(STAT_PersianProjectileAcquire);
+	FClassPool& Pool = this->Pools.FindOrAdd(Class.Get());
+	APersianProjectile* Projectile = nullptr;
+	while (Projectile == nullptr && Pool.Parked.Num() > 0) {
+		Projectile = Pool.Parked.Pop(false).Get();
+	}
+	Pool.Active.RemoveAll([](TWeakObjectPtr<APersianProjectile> const& Active) { return !Active.IsValid(); });
+	if (Projectile == nullptr) {
+		int32 const Cap = FMath::Max(1, CVarProjectilePoolCap.GetValueOnGameThread());
+		if (Pool.Active.Num() >= Cap) {
+			/* Full, the oldest shot goes again */
+			Projectile = Pool.Active[0].Get();
+			Pool.Active.RemoveAt(0, 1, false);
+			DEC_DWORD_STAT(STAT_PersianProjectilesActive);
+		} else if ((Projectile = this->SpawnParked(Class.Get())) == nullptr) {
+			return nullptr;
+		}
+	}
+	Pool.Active.Add(Projectile);
+	INC_DWORD_STAT(STAT_PersianProjectilesActive);
+	Projectile->Launch(Transform);
+	return Projectile;
+}
+
+void UPersianProjectilePool::Release(APersianProjectile* Projectile) {
+	FClassPool* Pool = this->Pools.Find(Projectile->GetClass());
+	if (Pool == nullptr || Pool->Active.RemoveSingle(Projectile) == 0) {
+		return;
+	}
+	DEC_DWORD_STAT(STAT_PersianProjectilesActive);
+	Projectile->Park();
+	Pool->Parked.Add(Projectile);
+}
+
+void UPersianProjectilePool::Prewarm(TSubclassOf<APersianProjectile> Class, int32 Count) {
+	if (Class == nullptr) {
+		return;
+	}
+	if (Count < 0) {
+		Count = CVarProjectilePoolPrewarm.GetValueOnGameThread();
+	}
+	Count = FMath::Min(Count, CVarProjectilePoolCap.GetValueOnGameThread());
+	FClassPool& Pool = this->Pools.FindOrAdd(Class.Get());
+	while (Pool.Parked.Num() + Pool.Active.Num() < Count) {
+		APersianProjectile* Projectile = this->SpawnParked(Class.Get());
+		if (Projectile == nullptr) {
+			break;
+		}
+		Pool.Parked.Add(Projectile);
+	}
+}
+
+int32 UPersianProjectilePool::NumActive() const {
+	int32 Num = 0;
+	for (TPair<UClass*, FClassPool> const& Pool : this->Pools) {
+		Num += Pool.Value.Active.Num();
+	}
+	return Num;
+}
+
+int32 UPersianProjectilePool::NumParked() const {
+	int32 Num = 0;
+	for (TPair<UClass*, FClassPool> const& Pool : this->Pools) {
+		Num += Pool.Value.Parked.Num();
+	}
+	return Num;
+}
+
+void UPersianProjectilePool::Deinitialize() {
+	for (TPair<UClass*, FClassPool> const& Pool : this->Pools) {
+		DEC_DWORD_STAT_BY(STAT_PersianProjectilesActive, Pool.Value.Active.Num());
+	}
+	this->Pools.Empty();
+	Super::Deinitialize();
+}
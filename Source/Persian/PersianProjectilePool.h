@@ -0,0 +1,51 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PersianProjectilePool.generated.h"
+
+class APersianProjectile;
+
+/**
+ * Recycles projectiles instead of spawning and destroying one per shot.
+ * Projectiles of each class are pre-warmed, returned on hit or when their
+ * life span runs out, and capped by persian.ProjectilePool.Cap: past the cap
+ * the oldest projectile in flight is relaunched.
+ */
+UCLASS()
+class UPersianProjectilePool : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Launches a projectile of Class from Transform, pooled unless persian.ProjectilePool is 0.
+	 * Returns null when persian.ProjectileManager simulates it without an actor.
+	 */
+	static APersianProjectile* SpawnProjectile(UWorld* World, TSubclassOf<APersianProjectile> Class, FTransform const& Transform);
+
+	/** Launches a pooled projectile of Class from Transform */
+	APersianProjectile* Acquire(TSubclassOf<APersianProjectile> Class, FTransform const& Transform);
+	/** Parks Projectile until it is acquired again */
+	void Release(APersianProjectile* Projectile);
+	/** Spawns parked projectiles of Class until Count of them exist, within the cap (persian.ProjectilePool.Prewarm if negative) */
+	void Prewarm(TSubclassOf<APersianProjectile> Class, int32 Count = -1);
+
+	int32 NumActive() const;
+	int32 NumParked() const;
+
+	virtual void Deinitialize() override;
+
+private:
+	struct FClassPool
+	{
+		TArray<TWeakObjectPtr<APersianProjectile>> Parked;
+		/* In launch order, the oldest first */
+		TArray<TWeakObjectPtr<APersianProjectile>> Active;
+	};
+	TMap<UClass*, FClassPool> Pools;
+
+	APersianProjectile* SpawnParked(UClass* Class);
+};
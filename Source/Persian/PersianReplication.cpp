@@ -0,0 +1,99 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianReplication.h"
+#include "GameFramework/Actor.h"
+#include "Engine/NetSerialization.h"
+#include "Misc/NetworkGuid.h"
+#include "Serialization/BitWriter.h"
+#include "UObject/CoreNet.h"
+
+//////////////////////////////////////////////////////////////////////////
+// PersianNet
+
+namespace PersianNet
+{
+
+uint16 QuantizeScale(double Scale) {
+	return uint16(FMath::RoundToInt(FMath::Clamp(Scale / MaxQuantizedScale, 0.0, 1.0) * MAX_uint16));
+}
+
+double DequantizeScale(uint16 Quantized) {
+	return Quantized * MaxQuantizedScale / MAX_uint16;
+}
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FReplicatedHeldState
+
+bool FReplicatedHeldState::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
+	bOutSuccess = true;
+	uint8 bHasObject = this->Object != nullptr;
+	Ar.SerializeBits(&bHasObject, 1);
+	if (!bHasObject) {
+		if (Ar.IsLoading()) {
+			*this = FReplicatedHeldState();
+		}
+		return true;
+	}
+
+	UObject* ObjectRef = this->Object;
+	bOutSuccess &= Map->SerializeObject(Ar, AActor::StaticClass(), ObjectRef);
+	bOutSuccess &= this->SerializePose(Ar);
+	if (Ar.IsLoading()) {
+		this->Object = Cast<AActor>(ObjectRef);
+	}
+	return bOutSuccess;
+}
+
+bool FReplicatedHeldState::SerializePose(FArchive& Ar) {
+	uint8 bWasReleased = this->bReleased;
+	Ar.SerializeBits(&bWasReleased, 1);
+	this->bReleased = bWasReleased != 0;
+	this->Rotation.SerializeCompressedShort(Ar);
+	bool const bSuccess = SerializePackedVector<10, 24>(this->Offset, Ar);
+	if (this->bReleased) {
+		/* A world scale can be past MaxQuantizedScale, and is sent once per release */
+		Ar << this->Scale3D;
+		if (Ar.IsLoading()) {
+			this->Dist = 0;
+		}
+		return bSuccess;
+	}
+
+	/* Magnitudes are quantized from 0 up, the signs of mirrored objects go apart */
+	uint8 Signs = (this->Scale3D.X < 0) | (this->Scale3D.Y < 0) << 1 | (this->Scale3D.Z < 0) << 2;
+	Ar.SerializeBits(&Signs, 3);
+	uint16 Scale[3] = {
+		PersianNet::QuantizeScale(FMath::Abs(this->Scale3D.X)),
+		PersianNet::QuantizeScale(FMath::Abs(this->Scale3D.Y)),
+		PersianNet::QuantizeScale(FMath::Abs(this->Scale3D.Z)),
+	};
+	Ar << Scale[0] << Scale[1] << Scale[2];
+
+	uint32 FixedDist = uint32(FMath::Clamp<double>(FMath::RoundToDouble(this->Dist * PersianNet::DistanceSteps), 0, MAX_int32));
+	Ar.SerializeIntPacked(FixedDist);
+
+	if (Ar.IsLoading()) {
+		this->Scale3D = FVector(
+			(Signs & 1 ? -1 : 1) * PersianNet::DequantizeScale(Scale[0]),
+			(Signs & 2 ? -1 : 1) * PersianNet::DequantizeScale(Scale[1]),
+			(Signs & 4 ? -1 : 1) * PersianNet::DequantizeScale(Scale[2]));
+		this->Dist = FixedDist / PersianNet::DistanceSteps;
+	}
+	return bSuccess;
+}
+
+int32 FReplicatedHeldState::MeasureNetBytes(UPackageMap const* Map) const {
+	FBitWriter Writer(256, true);
+	uint8 bHasObject = this->Object != nullptr;
+	Writer.SerializeBits(&bHasObject, 1);
+	if (bHasObject) {
+		/* Object references go as the packed NetGUID the connection knows them by */
+		FNetworkGUID NetGUID = Map != nullptr ? Map->GetNetGUIDFromObject(this->Object) : FNetworkGUID();
+		Writer << NetGUID;
+		FReplicatedHeldState Pose = *this;
+		Pose.SerializePose(Writer);
+	}
+	return int32(FMath::DivideAndRoundUp<int64>(Writer.GetNumBits(), 8));
+}
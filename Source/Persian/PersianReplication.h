@@ -0,0 +1,74 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PersianReplication.generated.h"
+
+class AActor;
+class UPackageMap;
+
+/** Quantization of the forced-perspective state sent to clients */
+namespace PersianNet
+{
+	/** Relative placement scales are sent on 16 bits over [0, MaxQuantizedScale] */
+	constexpr double MaxQuantizedScale = 64;
+	/** Grab distances are sent as unsigned fixed point with this many steps per unit */
+	constexpr double DistanceSteps = 16;
+	uint16 QuantizeScale(double Scale);
+	double DequantizeScale(uint16 Quantized);
+}
+
+/**
+ * Grab state of a holder as seen by the other clients: the held object, its
+ * pose relative to the holder's camera and the grab distance, or once let go
+ * of, the final world pose of the object.  Sent compressed, about 20 bytes per
+ * grab or release, nothing while holding.
+ */
+USTRUCT()
+struct FReplicatedHeldState
+{
+	GENERATED_BODY()
+
+	/** Held object, or the object last let go of when bReleased, null when neither */
+	UPROPERTY()
+	AActor* Object = nullptr;
+
+	/**
+	 * Object was let go of: Rotation, Offset and Scale3D are its final world
+	 * pose, the scale of which its movement replication does not carry.
+	 */
+	UPROPERTY()
+	bool bReleased = false;
+
+	/** Camera-relative rotation, sent as three 16-bit angles */
+	UPROPERTY()
+	FRotator Rotation = FRotator::ZeroRotator;
+
+	/** Camera-relative location, sent at 0.1 unit precision */
+	UPROPERTY()
+	FVector Offset = FVector::ZeroVector;
+
+	/** Object scale at grab time, sent as a sign bit and 16 bits over [0, MaxQuantizedScale] per axis, in full once released */
+	UPROPERTY()
+	FVector Scale3D = FVector::OneVector;
+
+	/** Grab distance, sent in fixed point */
+	UPROPERTY()
+	float Dist = 0;
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+	/** Bytes NetSerialize writes for the connection of Map, the property header aside */
+	int32 MeasureNetBytes(UPackageMap const* Map) const;
+
+private:
+	/* Everything but the object reference */
+	bool SerializePose(FArchive& Ar);
+};
+
+template<>
+struct TStructOpsTypeTraits<FReplicatedHeldState> : public TStructOpsTypeTraitsBase2<FReplicatedHeldState> {
+	enum {
+		WithNetSerializer = true
+	};
+};
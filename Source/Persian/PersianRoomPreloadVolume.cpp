@@ -0,0 +1,49 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianRoomPreloadVolume.h"
+#include "Persian.h"
+#include "Components/BoxComponent.h"
+#include "GameFramework/Pawn.h"
+#include "Kismet/GameplayStatics.h"
+
+APersianRoomPreloadVolume::APersianRoomPreloadVolume() {
+	this->Trigger = CreateDefaultSubobject<UBoxComponent>(TEXT("Trigger"));
+	this->Trigger->SetBoxExtent(FVector(400.0f, 400.0f, 200.0f));
+	this->Trigger->SetCollisionProfileName(TEXT("Trigger"));
+	this->Trigger->OnComponentBeginOverlap.AddDynamic(this, &APersianRoomPreloadVolume::OnTriggerBeginOverlap);
+	this->RootComponent = this->Trigger;
+
+	this->bMakeVisible = false;
+	this->bRequested = false;
+	this->RequestTime = 0;
+	this->NumPending = 0;
+}
+
+void APersianRoomPreloadVolume::OnTriggerBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult) {
+	APawn const* Pawn = Cast<APawn>(OtherActor);
+	if (this->bRequested || Pawn == nullptr || !Pawn->IsPlayerControlled()) {
+		return;
+	}
+	this->bRequested = true;
+	this->RequestTime = FPlatformTime::Seconds();
+
+	for (TSoftObjectPtr<UWorld> const& Room : this->Rooms) {
+		if (Room.IsNull()) {
+			continue;
+		}
+		/* Latent actions are keyed by callback target and UUID, one per room */
+		FLatentActionInfo LatentInfo;
+		LatentInfo.CallbackTarget = this;
+		LatentInfo.ExecutionFunction = GET_FUNCTION_NAME_CHECKED(APersianRoomPreloadVolume, OnRoomLoaded);
+		LatentInfo.UUID = this->NumPending++;
+		LatentInfo.Linkage = 0;
+		UGameplayStatics::LoadStreamLevelBySoftObjectPtr(this, Room, this->bMakeVisible, false, LatentInfo);
+	}
+}
+
+void APersianRoomPreloadVolume::OnRoomLoaded() {
+	if (--this->NumPending == 0) {
+		UE_LOG(LogPersianStartup, Log, TEXT("%s: %d rooms preloaded in %.2f ms"), *this->GetName(),
+			this->Rooms.Num(), (FPlatformTime::Seconds() - this->RequestTime) * 1000);
+	}
+}
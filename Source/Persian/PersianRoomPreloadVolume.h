@@ -0,0 +1,47 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "PersianRoomPreloadVolume.generated.h"
+
+class UBoxComponent;
+
+/**
+ * Starts streaming the puzzle rooms ahead of the player: when a pawn enters
+ * the box, every level in Rooms is loaded asynchronously, so that the room is
+ * resident by the time its door is reached.  Place one in front of each room
+ * of the persistent level.
+ */
+UCLASS()
+class PERSIAN_API APersianRoomPreloadVolume : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	APersianRoomPreloadVolume();
+
+	/** Streamed sublevels to load once a pawn enters the box */
+	UPROPERTY(EditAnywhere, Category = Persian)
+	TArray<TSoftObjectPtr<UWorld>> Rooms;
+
+	/** Whether the rooms are shown as soon as they are loaded, or only kept resident */
+	UPROPERTY(EditAnywhere, Category = Persian)
+	bool bMakeVisible;
+
+protected:
+	UPROPERTY(VisibleAnywhere, Category = Persian)
+	UBoxComponent* Trigger;
+
+	UFUNCTION()
+	void OnTriggerBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult);
+
+	UFUNCTION()
+	void OnRoomLoaded();
+
+private:
+	bool bRequested;
+	double RequestTime;
+	int32 NumPending;
+};
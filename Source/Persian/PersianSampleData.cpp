@@ -0,0 +1,124 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianSampleData.h"
+#include "PersianSampling.h"
+#include "Engine/StaticMesh.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/ObjectKey.h"
+
+static TAutoConsoleVariable<int32> CVarSampleCacheBudget(
+	TEXT("persian.SampleCache.Budget"),
+	4096,
+	TEXT("Number of samples baked or cached per mesh, before the view-dependent reduction of Attach."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSampleCacheMaxKB(
+	TEXT("persian.SampleCache.MaxKB"),
+	16384,
+	TEXT("Memory cap of the runtime placement sample cache, in KiB."),
+	ECVF_Default);
+
+//////////////////////////////////////////////////////////////////////////
+// UPersianSampleData
+
+UPersianSampleData::UPersianSampleData()
+{
+	Geometry = EPlacementGeometry::Collision;
+	Budget = 4096;
+}
+
+void UPersianSampleData::Rebuild(UStaticMesh* Mesh) {
+	PersianSampleCache::BuildSamples(Mesh, this->Geometry, this->Budget, this->Points);
+}
+
+void UPersianSampleData::PreSave(const class ITargetPlatform* TargetPlatform) {
+	Super::PreSave(TargetPlatform);
+#if WITH_EDITOR
+	/* Cook step: the samples are rebaked from the mesh every time it is saved or cooked */
+	if (UStaticMesh* Mesh = Cast<UStaticMesh>(this->GetOuter())) {
+		this->Rebuild(Mesh);
+	}
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PersianSampleCache
+
+namespace PersianSampleCache
+{
+
+struct FCacheEntry
+{
+	TArray<FVector> Points;
+	uint64 LastUse;
+};
+
+typedef TPair<FObjectKey, uint8> FCacheKey;
+
+static TMap<FCacheKey, FCacheEntry> Entries;
+static uint64 UseCounter = 0;
+static SIZE_T CachedBytes = 0;
+
+int32 GetBakeBudget() {
+	return CVarSampleCacheBudget.GetValueOnGameThread();
+}
+
+void BuildSamples(UStaticMesh* Mesh, EPlacementGeometry Geometry, int32 Budget, TArray<FVector>& OutPoints) {
+	OutPoints.Reset();
+	if (Mesh == nullptr) {
+		return;
+	}
+	if (Geometry == EPlacementGeometry::Collision
+		&& PersianSampling::GatherCollisionPoints(Mesh->GetBodySetup(), OutPoints)) {
+		/* A handful of exact points already */
+	} else if (Mesh->RenderData != nullptr && Mesh->GetNumVertices(0) > 0) {
+		FPositionVertexBuffer const& verts = Mesh->RenderData->LODResources[0].VertexBuffers.PositionVertexBuffer;
+		/* Kept on the CPU in the editor, and in cooked builds with bAllowCPUAccess: no points otherwise */
+		if (verts.GetVertexData() != nullptr) {
+			OutPoints.Append(&verts.VertexPosition(0), verts.GetNumVertices());
+		}
+	}
+	PersianSampling::ReducePoints(OutPoints, Budget);
+}
+
+TArray<FVector> const* FindOrBuild(UStaticMesh* Mesh, EPlacementGeometry Geometry) {
+	if (Mesh == nullptr) {
+		return nullptr;
+	}
+	UPersianSampleData const* Baked = Mesh->GetAssetUserData<UPersianSampleData>();
+	if (Baked != nullptr && Baked->Geometry == Geometry && Baked->Points.Num() > 0) {
+		return &Baked->Points;
+	}
+
+	FCacheKey const Key(FObjectKey(Mesh), uint8(Geometry));
+	if (FCacheEntry* Entry = Entries.Find(Key)) {
+		Entry->LastUse = ++UseCounter;
+		return Entry->Points.Num() > 0 ? &Entry->Points : nullptr;
+	}
+
+	FCacheEntry Entry;
+	BuildSamples(Mesh, Geometry, GetBakeBudget(), Entry.Points);
+	Entry.LastUse = ++UseCounter;
+	SIZE_T const EntryBytes = Entry.Points.GetAllocatedSize();
+
+	/* Evict least recently used meshes until the new one fits */
+	SIZE_T const MaxBytes = SIZE_T(FMath::Max(0, CVarSampleCacheMaxKB.GetValueOnGameThread())) * 1024;
+	while (Entries.Num() > 0 && CachedBytes + EntryBytes > MaxBytes) {
+		FCacheKey OldestKey = Key;
+		uint64 OldestUse = MAX_uint64;
+		for (TPair<FCacheKey, FCacheEntry> const& Cached : Entries) {
+			if (Cached.Value.LastUse < OldestUse) {
+				OldestKey = Cached.Key;
+				OldestUse = Cached.Value.LastUse;
+			}
+		}
+		CachedBytes -= Entries[OldestKey].Points.GetAllocatedSize();
+		Entries.Remove(OldestKey);
+	}
+
+	CachedBytes += EntryBytes;
+	FCacheEntry& Added = Entries.Add(Key, MoveTemp(Entry));
+	return Added.Points.Num() > 0 ? &Added.Points : nullptr;
+}
+
+}
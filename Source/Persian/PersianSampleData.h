@@ -0,0 +1,70 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/AssetUserData.h"
+#include "PersianSampleData.generated.h"
+
+class UStaticMesh;
+
+/** Where the placement samples of a mesh are taken from */
+UENUM(BlueprintType)
+enum class EPlacementGeometry : uint8 {
+	/** Simple collision shapes of the mesh body, render vertices when it has none */
+	Collision,
+	/** LOD0 render vertices, needs CPU-accessible render data in cooked builds */
+	RenderVertices,
+};
+
+/**
+ * Pre-reduced placement samples of a static mesh, in mesh space.
+ * Added by the PersianBakeSamples commandlet and rebaked whenever the mesh
+ * is saved or cooked, so that Attach never walks the mesh's vertex buffers.
+ */
+UCLASS()
+class UPersianSampleData : public UAssetUserData
+{
+	GENERATED_BODY()
+
+public:
+	UPersianSampleData();
+
+	/** Geometry the samples were taken from */
+	UPROPERTY(EditAnywhere, Category = "Persian")
+	EPlacementGeometry Geometry;
+
+	/** Maximum number of samples kept when baking */
+	UPROPERTY(EditAnywhere, Category = "Persian")
+	int32 Budget;
+
+	/** Baked samples, in mesh space */
+	UPROPERTY(VisibleAnywhere, Category = "Persian")
+	TArray<FVector> Points;
+
+	/** Rebakes Points from Mesh */
+	void Rebuild(UStaticMesh* Mesh);
+
+	virtual void PreSave(const class ITargetPlatform* TargetPlatform) override;
+};
+
+/**
+ * Mesh-space placement samples for meshes without baked data, kept in a
+ * least-recently-used cache capped by persian.SampleCache.MaxKB.
+ * Game thread only.
+ */
+namespace PersianSampleCache
+{
+	/** Default number of samples kept per mesh, see persian.SampleCache.Budget */
+	int32 GetBakeBudget();
+
+	/** Builds the samples of Mesh from its geometry, reduced to Budget points (0 keeps all) */
+	void BuildSamples(UStaticMesh* Mesh, EPlacementGeometry Geometry, int32 Budget, TArray<FVector>& OutPoints);
+
+	/**
+	 * Samples of Mesh: its baked data when it matches Geometry, else a cached
+	 * or freshly built set.  Returns null when the mesh has no points; the
+	 * result stays valid until the next call.
+	 */
+	TArray<FVector> const* FindOrBuild(UStaticMesh* Mesh, EPlacementGeometry Geometry);
+}
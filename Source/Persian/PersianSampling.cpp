@@ -0,0 +1,222 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianSampling.h"
+#include "PhysicsEngine/BodySetup.h"
+
+#include <limits>
+
+namespace PersianSampling
+{
+
+/* Yaw and pitch of a camera-space direction */
+static FVector2D ViewAngles(FVector const &d) {
+	return FVector2D(
+		FMath::Atan2(d.Y, d.X),
+		FMath::Atan2(d.Z, FVector2D(d.X, d.Y).Size())
+	);
+}
+
+void ReduceDirections(FDirectionSamples& Directions, int32 Budget) {
+	if (Budget <= 0 || Directions.Num() <= Budget) {
+		return;
+	}
+	int32 const Num = Directions.Num();
+
+	TArray<FVector2D> Angles;
+	Angles.SetNumUninitialized(Num);
+	FBox2D Range(ForceInit);
+	for (int32 i = 0; i < Num; ++i) {
+		Angles[i] = ViewAngles(Directions.GetUnit(i));
+		Range += Angles[i];
+	}
+
+	/* Extreme points of the angular 8-DOP, i.e. the silhouette as seen from the camera */
+	static FVector2D const Axes[NumExtremes / 2] = {
+		FVector2D{1, 0}, FVector2D{0, 1}, FVector2D{1, 1}, FVector2D{1, -1},
+	};
+	int32 Extremes[NumExtremes];
+	float ExtremeDots[NumExtremes];
+	for (int32 k = 0; k < NumExtremes; ++k) {
+		Extremes[k] = 0;
+		ExtremeDots[k] = std::numeric_limits<float>::lowest();
+	}
+	for (int32 i = 0; i < Num; ++i) {
+		for (int32 a = 0; a < NumExtremes / 2; ++a) {
+			float const dot = Axes[a] | Angles[i];
+			if (dot > ExtremeDots[2 * a]) {
+				ExtremeDots[2 * a] = dot;
+				Extremes[2 * a] = i;
+			}
+			if (-dot > ExtremeDots[2 * a + 1]) {
+				ExtremeDots[2 * a + 1] = -dot;
+				Extremes[2 * a + 1] = i;
+			}
+		}
+	}
+
+	/* Angular bins around the camera axis, keeping the farthest sample of each bin */
+	int32 const Res = FMath::Max(1, FMath::FloorToInt(FMath::Sqrt(float(FMath::Max(1, Budget - NumExtremes)))));
+	FVector2D const Extent(
+		FMath::Max(Range.Max.X - Range.Min.X, KINDA_SMALL_NUMBER),
+		FMath::Max(Range.Max.Y - Range.Min.Y, KINDA_SMALL_NUMBER)
+	);
+	TArray<int32> Bins;
+	Bins.Init(INDEX_NONE, Res * Res);
+	for (int32 i = 0; i < Num; ++i) {
+		int32 const x = FMath::Clamp(FMath::FloorToInt((Angles[i].X - Range.Min.X) / Extent.X * Res), 0, Res - 1);
+		int32 const y = FMath::Clamp(FMath::FloorToInt((Angles[i].Y - Range.Min.Y) / Extent.Y * Res), 0, Res - 1);
+		int32& Bin = Bins[y * Res + x];
+		if (Bin == INDEX_NONE || Directions.GetLength(i) > Directions.GetLength(Bin)) {
+			Bin = i;
+		}
+	}
+
+	TBitArray<> Kept(false, Num);
+	TArray<int32> Reduced;
+	Reduced.Reserve(Budget);
+	auto Keep = [&](int32 i) {
+		if (i != INDEX_NONE && !Kept[i]) {
+			Kept[i] = true;
+			Reduced.Add(i);
+		}
+	};
+	for (int32 k = 0; k < NumExtremes; ++k) {
+		Keep(Extremes[k]);
+	}
+	for (int32 Bin : Bins) {
+		Keep(Bin);
+	}
+	/* Budgets under NumExtremes + 1 cannot hold every pick: the first extremes win */
+	if (Reduced.Num() > Budget) {
+		Reduced.SetNum(Budget);
+	}
+	Directions.Gather(Reduced);
+}
+
+/* Unit directions of the 26-DOP: face, edge and corner directions of a cube */
+static TArray<FVector> const& SupportDirections() {
+	static TArray<FVector> const Directions = []() {
+		TArray<FVector> Result;
+		for (int32 x = -1; x <= 1; ++x) {
+			for (int32 y = -1; y <= 1; ++y) {
+				for (int32 z = -1; z <= 1; ++z) {
+					if (x != 0 || y != 0 || z != 0) {
+						Result.Add(FVector(x, y, z).GetUnsafeNormal());
+					}
+				}
+			}
+		}
+		return Result;
+	}();
+	return Directions;
+}
+
+/* Support points of the sphere-swept segment between A (radius RA) and B (radius RB) */
+static void AddSweptSphereSupport(FVector const &A, float RA, FVector const &B, float RB, TArray<FVector>& OutPoints) {
+	for (FVector const& d : SupportDirections()) {
+		FVector const SupportA = A + d * RA;
+		FVector const SupportB = B + d * RB;
+		OutPoints.Add((SupportA | d) >= (SupportB | d) ? SupportA : SupportB);
+	}
+}
+
+bool GatherCollisionPoints(UBodySetup const* BodySetup, TArray<FVector>& OutPoints) {
+	if (BodySetup == nullptr) {
+		return false;
+	}
+	FKAggregateGeom const& Geom = BodySetup->AggGeom;
+	int32 const NumBefore = OutPoints.Num();
+
+	for (FKSphereElem const& Sphere : Geom.SphereElems) {
+		AddSweptSphereSupport(Sphere.Center, Sphere.Radius, Sphere.Center, Sphere.Radius, OutPoints);
+	}
+	for (FKBoxElem const& Box : Geom.BoxElems) {
+		FTransform const BoxTM(Box.Rotation, Box.Center);
+		FVector const HalfExtent(Box.X * 0.5f, Box.Y * 0.5f, Box.Z * 0.5f);
+		for (int32 Corner = 0; Corner < 8; ++Corner) {
+			OutPoints.Add(BoxTM.TransformPosition(HalfExtent * FVector(
+				(Corner & 1) ? 1 : -1, (Corner & 2) ? 1 : -1, (Corner & 4) ? 1 : -1)));
+		}
+	}
+	for (FKSphylElem const& Sphyl : Geom.SphylElems) {
+		FVector const Axis = Sphyl.Rotation.RotateVector(FVector(0, 0, Sphyl.Length * 0.5f));
+		AddSweptSphereSupport(Sphyl.Center + Axis, Sphyl.Radius, Sphyl.Center - Axis, Sphyl.Radius, OutPoints);
+	}
+	for (FKTaperedCapsuleElem const& Capsule : Geom.TaperedCapsuleElems) {
+		FVector const Axis = Capsule.Rotation.RotateVector(FVector(0, 0, Capsule.Length * 0.5f));
+		AddSweptSphereSupport(Capsule.Center + Axis, Capsule.Radius0, Capsule.Center - Axis, Capsule.Radius1, OutPoints);
+	}
+	for (FKConvexElem const& Convex : Geom.ConvexElems) {
+		FTransform const ConvexTM = Convex.GetTransform();
+		for (FVector const& v : Convex.VertexData) {
+			OutPoints.Add(ConvexTM.TransformPosition(v));
+		}
+	}
+	return OutPoints.Num() > NumBefore;
+}
+
+void ReducePoints(TArray<FVector>& Points, int32 Budget) {
+	if (Budget <= 0 || Points.Num() <= Budget) {
+		return;
+	}
+	int32 const Num = Points.Num();
+	TArray<FVector> const& Axes = SupportDirections();
+	FBox const Bounds(Points.GetData(), Num);
+	FVector const Center = Bounds.GetCenter();
+
+	TArray<int32> Extremes;
+	for (FVector const& Axis : Axes) {
+		int32 Best = 0;
+		for (int32 i = 1; i < Num; ++i) {
+			if ((Points[i] | Axis) > (Points[Best] | Axis)) {
+				Best = i;
+			}
+		}
+		Extremes.AddUnique(Best);
+	}
+
+	/* Cubic cells, coarsened until the occupied ones fit in what is left of the budget */
+	int32 const CellBudget = FMath::Max(1, Budget - Extremes.Num());
+	float const Longest = FMath::Max(Bounds.GetSize().GetMax(), KINDA_SMALL_NUMBER);
+	TMap<FIntVector, int32> Cells;
+	for (int32 Res = FMath::Max(1, FMath::CeilToInt(2 * FMath::Sqrt(float(CellBudget)))); ; Res = Res * 4 / 5) {
+		float const CellSize = Longest / Res;
+		Cells.Reset();
+		for (int32 i = 0; i < Num; ++i) {
+			FVector const Cell = (Points[i] - Bounds.Min) / CellSize;
+			FIntVector const Key(FMath::FloorToInt(Cell.X), FMath::FloorToInt(Cell.Y), FMath::FloorToInt(Cell.Z));
+			int32* Best = Cells.Find(Key);
+			if (Best == nullptr) {
+				Cells.Add(Key, i);
+			} else if (FVector::DistSquared(Points[i], Center) > FVector::DistSquared(Points[*Best], Center)) {
+				*Best = i;
+			}
+		}
+		if (Cells.Num() <= CellBudget || Res <= 1) {
+			break;
+		}
+	}
+
+	TBitArray<> Kept(false, Num);
+	TArray<FVector> Reduced;
+	Reduced.Reserve(Extremes.Num() + Cells.Num());
+	auto Keep = [&](int32 i) {
+		if (!Kept[i]) {
+			Kept[i] = true;
+			Reduced.Add(Points[i]);
+		}
+	};
+	for (int32 i : Extremes) {
+		Keep(i);
+	}
+	for (TPair<FIntVector, int32> const& Cell : Cells) {
+		Keep(Cell.Value);
+	}
+	/* Small budgets cannot hold every extreme, the first axes win */
+	if (Reduced.Num() > Budget) {
+		Reduced.SetNum(Budget);
+	}
+	Points = MoveTemp(Reduced);
+}
+
+}
@@ -0,0 +1,45 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PersianDirections.h"
+
+class UBodySetup;
+
+/**
+ * Reduction of the camera-space direction list built by UForcedPerspectiveComponent::Attach.
+ *
+ * The placement solve only cares, for every ray leaving the camera, about the
+ * sample lying farthest along it, so samples are binned by view angle around
+ * the camera axis and only the farthest one of each bin is kept.  The extreme
+ * points of an angular 8-DOP are always kept so that the silhouette of the
+ * held object is preserved.
+ */
+namespace PersianSampling
+{
+	/** Number of angular k-DOP extremes that are always kept */
+	constexpr int32 NumExtremes = 8;
+
+	/**
+	 * Reduces Directions (camera space, X forward) to at most Budget samples.
+	 * A Budget of 0 or less keeps every sample; one under NumExtremes + 1
+	 * keeps the first Budget extremes only.
+	 */
+	void ReduceDirections(FDirectionSamples& Directions, int32 Budget);
+
+	/**
+	 * Appends points bounding the simple collision of BodySetup, in mesh space:
+	 * box corners, support points of spheres and capsules along the 26 k-DOP
+	 * directions, and convex hull vertices.
+	 * Returns false when the body has no simple shapes to offer.
+	 */
+	bool GatherCollisionPoints(UBodySetup const* BodySetup, TArray<FVector>& OutPoints);
+
+	/**
+	 * View-independent reduction of mesh-space Points to at most Budget points,
+	 * used when baking: the 26-DOP extremes plus, for every cell of a uniform
+	 * grid, the point farthest from the centre of the bounds.
+	 */
+	void ReducePoints(TArray<FVector>& Points, int32 Budget);
+}
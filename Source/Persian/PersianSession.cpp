@@ -0,0 +1,273 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianSession.h"
+#include "Persian.h"
+#include "PersianCharacter.h"
+#include "PersianPlacementSubsystem.h"
+#include "Camera/CameraComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogPersianSession, Log, All);
+
+//////////////////////////////////////////////////////////////////////////
+// FSessionFrame, FSessionFile
+
+FArchive& operator<<(FArchive& Ar, FSessionFrame& Frame) {
+	Ar << Frame.Location;
+	/* Same 16-bit axes as replicated rotations */
+	uint16 Pitch = FRotator::CompressAxisToShort(Frame.ViewRotation.Pitch);
+	uint16 Yaw = FRotator::CompressAxisToShort(Frame.ViewRotation.Yaw);
+	uint16 Roll = FRotator::CompressAxisToShort(Frame.ViewRotation.Roll);
+	Ar << Pitch << Yaw << Roll;
+	if (Ar.IsLoading()) {
+		Frame.ViewRotation = FRotator(FRotator::DecompressAxisFromShort(Pitch),
+			FRotator::DecompressAxisFromShort(Yaw), FRotator::DecompressAxisFromShort(Roll));
+	}
+	Ar << Frame.Flags;
+	return Ar;
+}
+
+bool FSessionFile::Save(FString const& Path) const {
+	TArray<uint8> Bytes;
+	FMemoryWriter Ar(Bytes);
+	uint32 FileMagic = Magic, FileVersion = Version;
+	FString Map = this->MapName;
+	float Step = this->FixedDeltaTime;
+	int32 NumFrames = this->Frames.Num();
+	Ar << FileMagic << FileVersion << Map << Step << NumFrames;
+	for (FSessionFrame Frame : this->Frames) {
+		Ar << Frame;
+	}
+	return FFileHelper::SaveArrayToFile(Bytes, *Path);
+}
+
+bool FSessionFile::Load(FString const& Path) {
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *Path)) {
+		return false;
+	}
+	FMemoryReader Ar(Bytes);
+	uint32 FileMagic = 0, FileVersion = 0;
+	Ar << FileMagic << FileVersion;
+	if (FileMagic != Magic || FileVersion != Version) {
+		return false;
+	}
+	int32 NumFrames = 0;
+	Ar << this->MapName << this->FixedDeltaTime << NumFrames;
+	if (Ar.IsError() || NumFrames < 0 || int64(NumFrames) * 19 > Ar.TotalSize() - Ar.Tell()) {
+		return false;
+	}
+	this->Frames.SetNumUninitialized(NumFrames);
+	for (FSessionFrame& Frame : this->Frames) {
+		Ar << Frame;
+	}
+	return !Ar.IsError();
+}
+
+FString FSessionFile::GetPath(FString const& Name) {
+	return FPaths::ProjectSavedDir() / TEXT("Persian") / TEXT("Sessions") / (Name + TEXT(".psession"));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FSessionTickFunction
+
+void FSessionTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread,
+	const FGraphEventRef& MyCompletionGraphEvent) {
+	if (this->Target != nullptr && TickType != LEVELTICK_ViewportsOnly) {
+		this->Target->TickSession();
+	}
+}
+
+FString FSessionTickFunction::DiagnosticMessage() {
+	return TEXT("UPersianSessionSubsystem[TickSession]");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UPersianSessionSubsystem
+
+static double GetSortedPercentile(TArray<double> Samples, double Percentile) {
+	if (Samples.Num() == 0) {
+		return 0;
+	}
+	Samples.Sort();
+	return Samples[FMath::Clamp(FMath::CeilToInt(Percentile * Samples.Num()) - 1, 0, Samples.Num() - 1)];
+}
+
+UPersianSessionSubsystem::UPersianSessionSubsystem()
+{
+	this->Mode = EMode::Idle;
+	this->bFirePending = false;
+	this->Cursor = 0;
+	this->LastFrameTime = 0;
+	this->FlushSecondsBefore = 0;
+	this->bExitWhenDone = false;
+	this->bSavedUseFixedTimeStep = false;
+	this->SavedFixedDeltaTime = 0;
+	this->SessionTick.bCanEverTick = true;
+	this->SessionTick.bStartWithTickEnabled = true;
+	this->SessionTick.Target = this;
+}
+
+void UPersianSessionSubsystem::StartTick(ETickingGroup Group) {
+	this->StopTick();
+	this->SessionTick.Target = this;
+	this->SessionTick.TickGroup = Group;
+	this->SessionTick.RegisterTickFunction(this->GetWorld()->PersistentLevel);
+}
+
+void UPersianSessionSubsystem::StopTick() {
+	if (this->SessionTick.IsTickFunctionRegistered()) {
+		this->SessionTick.UnRegisterTickFunction();
+	}
+}
+
+void UPersianSessionSubsystem::StartRecording(APersianCharacter* InCharacter, float FixedDeltaTime) {
+	if (InCharacter == nullptr || this->Mode != EMode::Idle) {
+		return;
+	}
+	this->Mode = EMode::Recording;
+	this->Character = InCharacter;
+	this->Session = FSessionFile();
+	this->Session.MapName = this->GetWorld()->GetMapName();
+	this->Session.FixedDeltaTime = FixedDeltaTime;
+	this->bFirePending = false;
+	/* After the camera update, the pose is the one the frame was rendered with */
+	this->StartTick(TG_PostUpdateWork);
+}
+
+bool UPersianSessionSubsystem::StopRecording(FString const& Path) {
+	if (this->Mode != EMode::Recording) {
+		return false;
+	}
+	this->StopTick();
+	this->Mode = EMode::Idle;
+	this->Character = nullptr;
+	bool const bSaved = this->Session.Save(Path);
+	UE_LOG(LogPersianSession, Log, TEXT("%s %d frames to %s"), bSaved ? TEXT("Saved") : TEXT("Could not save"),
+		this->Session.Frames.Num(), *Path);
+	this->Session = FSessionFile();
+	return bSaved;
+}
+
+void UPersianSessionSubsystem::NoteFire(APersianCharacter const* InCharacter) {
+	if (this->Mode == EMode::Recording && this->Character.Get() == InCharacter) {
+		this->bFirePending = true;
+	}
+}
+
+void UPersianSessionSubsystem::StartReplay(APersianCharacter* InCharacter, FSessionFile&& InSession,
+	FString const& InReportName, bool bInExitWhenDone) {
+	if (InCharacter == nullptr || this->Mode != EMode::Idle) {
+		return;
+	}
+	this->Mode = EMode::Replaying;
+	this->Character = InCharacter;
+	this->Session = MoveTemp(InSession);
+	this->ReportName = InReportName;
+	this->bExitWhenDone = bInExitWhenDone;
+	this->Cursor = 0;
+	this->FrameMs.Reset(this->Session.Frames.Num());
+	this->SolveMs.Reset(this->Session.Frames.Num());
+
+	/* Same simulated time every run, however fast the machine */
+	this->bSavedUseFixedTimeStep = FApp::UseFixedTimeStep();
+	this->SavedFixedDeltaTime = FApp::GetFixedDeltaTime();
+	FApp::SetUseFixedTimeStep(true);
+	FApp::SetFixedDeltaTime(this->Session.FixedDeltaTime);
+	/* Before the character and its input tick, like live input */
+	this->StartTick(TG_PrePhysics);
+	UE_LOG(LogPersianSession, Log, TEXT("Replaying %d frames of %s at %.1f Hz"), this->Session.Frames.Num(),
+		*this->Session.MapName, 1.0f / FMath::Max(this->Session.FixedDeltaTime, KINDA_SMALL_NUMBER));
+}
+
+void UPersianSessionSubsystem::TickSession() {
+	APersianCharacter* const Target = this->Character.Get();
+	if (this->Mode == EMode::Recording) {
+		if (Target == nullptr) {
+			return;
+		}
+		FSessionFrame& Frame = this->Session.Frames.AddDefaulted_GetRef();
+		Frame.Location = Target->GetActorLocation();
+		Frame.ViewRotation = Target->GetControlRotation();
+		Frame.Flags = this->bFirePending ? FSessionFrame::Fire : 0;
+		this->bFirePending = false;
+		return;
+	}
+	if (this->Mode != EMode::Replaying) {
+		return;
+	}
+
+	UPersianPlacementSubsystem const* Placement = this->GetWorld()->GetSubsystem<UPersianPlacementSubsystem>();
+	double const FlushSeconds = Placement != nullptr ? Placement->GetFlushSeconds() : 0;
+	double const Now = FPlatformTime::Seconds();
+	if (this->Cursor > 0) {
+		/* Whole previous frame, and the batched placement it flushed */
+		this->FrameMs.Add((Now - this->LastFrameTime) * 1000);
+		this->SolveMs.Last() += (FlushSeconds - this->FlushSecondsBefore) * 1000;
+	}
+	this->LastFrameTime = Now;
+	this->FlushSecondsBefore = FlushSeconds;
+	if (Target == nullptr || this->Cursor == this->Session.Frames.Num()) {
+		this->FinishReplay();
+		return;
+	}
+
+	FSessionFrame const& Frame = this->Session.Frames[this->Cursor++];
+	Target->SetActorLocation(Frame.Location, false, nullptr, ETeleportType::TeleportPhysics);
+	if (AController* Controller = Target->GetController()) {
+		Controller->SetControlRotation(Frame.ViewRotation);
+	}
+	/* The camera manager only catches up later in the frame, the grab trace needs the view now */
+	Target->GetFirstPersonCameraComponent()->SetWorldRotation(Frame.ViewRotation);
+	double Solve = 0;
+	if (Frame.Flags & FSessionFrame::Fire) {
+		double const Start = FPlatformTime::Seconds();
+		Target->OnFire();
+		Solve = FPlatformTime::Seconds() - Start;
+	}
+	this->SolveMs.Add(Solve * 1000);
+}
+
+void UPersianSessionSubsystem::FinishReplay() {
+	this->StopTick();
+	this->Mode = EMode::Idle;
+	this->Character = nullptr;
+	FApp::SetUseFixedTimeStep(this->bSavedUseFixedTimeStep);
+	FApp::SetFixedDeltaTime(this->SavedFixedDeltaTime);
+
+	FString Report = TEXT("Frame,FrameMs,SolveMs,Fire\n");
+	double TotalSolveMs = 0;
+	for (int32 i = 0; i < this->FrameMs.Num(); ++i) {
+		Report += FString::Printf(TEXT("%d,%.4f,%.4f,%d\n"), i, this->FrameMs[i], this->SolveMs[i],
+			(this->Session.Frames[i].Flags & FSessionFrame::Fire) ? 1 : 0);
+		TotalSolveMs += this->SolveMs[i];
+	}
+	FString const Path = FPaths::ProfilingDir() / TEXT("Persian") / FString::Printf(TEXT("Session-%s-%s.csv"),
+		*this->ReportName, *FDateTime::Now().ToString());
+	FFileHelper::SaveStringToFile(Report, *Path);
+	UE_LOG(LogPersianSession, Log, TEXT("%d frames: frame p50 %.3f ms p95 %.3f ms max %.3f ms, solve p95 %.3f ms max %.3f ms total %.3f ms"),
+		this->FrameMs.Num(), GetSortedPercentile(this->FrameMs, 0.5), GetSortedPercentile(this->FrameMs, 0.95),
+		GetSortedPercentile(this->FrameMs, 1), GetSortedPercentile(this->SolveMs, 0.95),
+		GetSortedPercentile(this->SolveMs, 1), TotalSolveMs);
+	UE_LOG(LogPersianSession, Log, TEXT("Wrote %s"), *Path);
+	this->Session = FSessionFile();
+	if (this->bExitWhenDone) {
+		FPlatformMisc::RequestExit(false);
+	}
+}
+
+void UPersianSessionSubsystem::Deinitialize() {
+	if (this->Mode == EMode::Replaying) {
+		FApp::SetUseFixedTimeStep(this->bSavedUseFixedTimeStep);
+		FApp::SetFixedDeltaTime(this->SavedFixedDeltaTime);
+	}
+	this->Mode = EMode::Idle;
+	this->StopTick();
+	Super::Deinitialize();
+}
@@ -0,0 +1,128 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PersianSession.generated.h"
+
+class APersianCharacter;
+class UPersianSessionSubsystem;
+
+/**
+ * One frame of a recorded session: where the pawn stood, where it looked and
+ * whether fire was pressed, which is all the input APersianCharacter acts on.
+ * 19 bytes on disk.
+ */
+struct FSessionFrame
+{
+	enum EFlags : uint8 {
+		Fire = 1 << 0,
+	};
+
+	FVector Location;
+	FRotator ViewRotation;
+	uint8 Flags;
+
+	friend FArchive& operator<<(FArchive& Ar, FSessionFrame& Frame);
+};
+
+/** A recorded session, as saved under Saved/Persian/Sessions */
+struct FSessionFile
+{
+	static uint32 const Magic = 0x4e535350; // "PSSN"
+	static uint32 const Version = 1;
+
+	FString MapName;
+	/** Time step the session is replayed at */
+	float FixedDeltaTime = 1.0f / 60;
+	TArray<FSessionFrame> Frames;
+
+	bool Save(FString const& Path) const;
+	bool Load(FString const& Path);
+	/** Default location of the session Name */
+	static FString GetPath(FString const& Name);
+};
+
+/** Records or replays a frame of the session, see UPersianSessionSubsystem */
+USTRUCT()
+struct FSessionTickFunction : public FTickFunction {
+	GENERATED_USTRUCT_BODY()
+
+	UPersianSessionSubsystem* Target;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread,
+		const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FSessionTickFunction> : public TStructOpsTypeTraitsBase2<FSessionTickFunction> {
+	enum {
+		WithCopy = false
+	};
+};
+
+/**
+ * Turns play sessions into repeatable performance cases.  Recording keeps
+ * the pose of one character and its fire presses every frame, once the view
+ * is final.  Replaying drives the same character from the file at a fixed
+ * time step, before anything else ticks, and times every frame along with
+ * the grab, release and placement work it causes; the report goes to
+ * Saved/Profiling/Persian.  See the persian.Session.* commands.
+ */
+UCLASS()
+class UPersianSessionSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UPersianSessionSubsystem();
+
+	bool IsRecording() const { return this->Mode == EMode::Recording; }
+	bool IsReplaying() const { return this->Mode == EMode::Replaying; }
+
+	/** Starts recording Character, replayed later at FixedDeltaTime */
+	void StartRecording(APersianCharacter* Character, float FixedDeltaTime);
+	/** Stops recording and saves the session to Path */
+	bool StopRecording(FString const& Path);
+	/** Notes that Character fired this frame, when it is the one recorded */
+	void NoteFire(APersianCharacter const* Character);
+
+	/** Replays Session on Character, then writes the report and quits the game if bExitWhenDone */
+	void StartReplay(APersianCharacter* Character, FSessionFile&& Session, FString const& ReportName, bool bExitWhenDone);
+
+	void TickSession();
+
+	virtual void Deinitialize() override;
+
+private:
+	enum class EMode : uint8 {
+		Idle,
+		Recording,
+		Replaying,
+	};
+	EMode Mode;
+	TWeakObjectPtr<APersianCharacter> Character;
+	FSessionFile Session;
+	FSessionTickFunction SessionTick;
+
+	/* Recording */
+	bool bFirePending;
+
+	/* Replay */
+	int32 Cursor;
+	double LastFrameTime;
+	double FlushSecondsBefore;
+	FString ReportName;
+	bool bExitWhenDone;
+	bool bSavedUseFixedTimeStep;
+	double SavedFixedDeltaTime;
+	TArray<double> FrameMs;
+	TArray<double> SolveMs;
+
+	void StartTick(ETickingGroup Group);
+	void StopTick();
+	void FinishReplay();
+};
@@ -0,0 +1,598 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianStaticScene.h"
+#include "Persian.h"
+#include "PersianCollision.h"
+#include "PersianInstanceProxy.h"
+#include "PersianPlacementSubsystem.h"
+#include "Async/ParallelFor.h"
+#include "CollisionQueryParams.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Level.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "StaticMeshResources.h"
+#include "WorldCollision.h"
+
+DECLARE_CYCLE_STAT(TEXT("Static BVH build"), STAT_PersianStaticBVHBuild, STATGROUP_Persian);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Static BVH triangles"), STAT_PersianStaticBVHTriangles, STATGROUP_Persian);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Static BVH rays"), STAT_PersianStaticBVHRays, STATGROUP_Persian);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Static BVH fallback primitives"), STAT_PersianStaticBVHCandidates, STATGROUP_Persian);
+
+static TAutoConsoleVariable<int32> CVarStaticBVH(
+	TEXT("persian.StaticBVH"),
+	1,
+	TEXT("Trace the placement rays against the BVH of the static level geometry, and the physics scene only\n")
+	TEXT("for what it does not hold. 0 traces every ray through the physics scene."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarStaticBVHLeafSize(
+	TEXT("persian.StaticBVH.LeafSize"),
+	4,
+	TEXT("Most triangles per leaf of the static BVH, applied to the levels loaded afterwards."),
+	ECVF_Default);
+
+/* Split planes tried per axis and node */
+static int32 const NumBins = 16;
+/* Deeper nodes are leaves whatever their size, so that the traversal stack never overflows */
+static int32 const MaxDepth = 60;
+
+/* Half the surface area of Box */
+static float HalfArea(FBox const &Box) {
+	FVector const Size = Box.GetSize();
+	return Size.X * Size.Y + Size.Y * Size.Z + Size.Z * Size.X;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FStaticBVH
+
+void FStaticBVH::Reset() {
+	this->Nodes.Reset();
+	this->Triangles.Reset();
+	this->Pending.Reset();
+}
+
+void FStaticBVH::AddTriangle(FVector const &A, FVector const &B, FVector const &C) {
+	this->Pending.Add(A);
+	this->Pending.Add(B);
+	this->Pending.Add(C);
+}
+
+void FStaticBVH::Build(int32 LeafSize) {
+	this->Nodes.Reset();
+	this->Triangles.Reset();
+	int32 const Num = this->Pending.Num() / 3;
+	if (Num == 0) {
+		this->Pending.Empty();
+		return;
+	}
+	TArray<FBox> Bounds;
+	TArray<FVector> Centers;
+	TArray<int32> Order;
+	Bounds.SetNumUninitialized(Num);
+	Centers.SetNumUninitialized(Num);
+	Order.SetNumUninitialized(Num);
+	for (int32 t = 0; t < Num; ++t) {
+		FVector const* Corners = &this->Pending[3 * t];
+		Bounds[t] = FBox(Corners, 3);
+		Centers[t] = (Corners[0] + Corners[1] + Corners[2]) / 3;
+		Order[t] = t;
+	}
+	this->Nodes.Reserve(2 * Num / FMath::Max(1, LeafSize) + 1);
+	this->BuildNode(Order, Bounds, Centers, 0, Num, FMath::Max(1, LeafSize), 0);
+	this->Nodes.Shrink();
+
+	/* Leaves own contiguous ranges, in the order the build left them */
+	this->Triangles.SetNumUninitialized(Num);
+	for (int32 k = 0; k < Num; ++k) {
+		FVector const* Corners = &this->Pending[3 * Order[k]];
+		this->Triangles[k] = FTriangle{ Corners[0], Corners[1] - Corners[0], Corners[2] - Corners[0] };
+	}
+	this->Pending.Empty();
+}
+
+int32 FStaticBVH::BuildNode(TArray<int32> &Order, TArray<FBox> const &Bounds, TArray<FVector> const &Centers,
+	int32 Begin, int32 End, int32 LeafSize, int32 Depth) {
+	int32 const Self = this->Nodes.AddUninitialized();
+	FBox Box(ForceInit);
+	FBox CenterBox(ForceInit);
+	for (int32 k = Begin; k < End; ++k) {
+		Box += Bounds[Order[k]];
+		CenterBox += Centers[Order[k]];
+	}
+	this->Nodes[Self].Min = Box.Min;
+	this->Nodes[Self].Max = Box.Max;
+	int32 const Count = End - Begin;
+	if (Count <= LeafSize || Depth >= MaxDepth) {
+		this->Nodes[Self].Index = Begin;
+		this->Nodes[Self].Count = Count;
+		return Self;
+	}
+
+	FVector const Extent = CenterBox.GetSize();
+	int32 const Axis = Extent.X > Extent.Y ? (Extent.X > Extent.Z ? 0 : 2) : (Extent.Y > Extent.Z ? 1 : 2);
+	/* Every centre in the same place: halves, in any order */
+	int32 Mid = Begin + Count / 2;
+	if (Extent[Axis] > KINDA_SMALL_NUMBER) {
+		/* Binned surface area heuristic along the widest axis of the centres */
+		float const Lo = CenterBox.Min[Axis];
+		float const BinsPerUnit = NumBins * (1 - KINDA_SMALL_NUMBER) / Extent[Axis];
+		auto BinOf = [&](int32 t) {
+			return FMath::Clamp(int32((Centers[t][Axis] - Lo) * BinsPerUnit), 0, NumBins - 1);
+		};
+		FBox BinBox[NumBins];
+		int32 BinCount[NumBins];
+		for (int32 b = 0; b < NumBins; ++b) {
+			BinBox[b].Init();
+			BinCount[b] = 0;
+		}
+		for (int32 k = Begin; k < End; ++k) {
+			int32 const b = BinOf(Order[k]);
+			BinBox[b] += Bounds[Order[k]];
+			++BinCount[b];
+		}
+		/* Area times count of everything past the split after bin b */
+		float RightCost[NumBins];
+		FBox Side(ForceInit);
+		int32 SideCount = 0;
+		for (int32 b = NumBins - 1; b > 0; --b) {
+			Side += BinBox[b];
+			SideCount += BinCount[b];
+			RightCost[b - 1] = SideCount > 0 ? HalfArea(Side) * SideCount : 0;
+		}
+		Side.Init();
+		SideCount = 0;
+		float BestCost = MAX_flt;
+		int32 BestSplit = INDEX_NONE;
+		for (int32 b = 0; b < NumBins - 1; ++b) {
+			Side += BinBox[b];
+			SideCount += BinCount[b];
+			if (SideCount == 0 || SideCount == Count) {
+				continue;
+			}
+			float const Cost = HalfArea(Side) * SideCount + RightCost[b];
+			if (Cost < BestCost) {
+				BestCost = Cost;
+				BestSplit = b;
+			}
+		}
+		if (BestSplit != INDEX_NONE) {
+			Mid = Begin;
+			for (int32 k = Begin; k < End; ++k) {
+				if (BinOf(Order[k]) <= BestSplit) {
+					Swap(Order[k], Order[Mid++]);
+				}
+			}
+		}
+	}
+
+	int32 const Left = this->BuildNode(Order, Bounds, Centers, Begin, Mid, LeafSize, Depth + 1);
+	check(Left == Self + 1);
+	int32 const Right = this->BuildNode(Order, Bounds, Centers, Mid, End, LeafSize, Depth + 1);
+	this->Nodes[Self].Index = Right;
+	this->Nodes[Self].Count = -1 - Axis;
+	return Self;
+}
+
+void FStaticBVH::RayCast(FVector const &Origin, FVector const* Dirs, int32 Num, float Far, float* OutDistances) const {
+	for (int32 i = 0; i < Num; i += 4) {
+		this->RayCast4(Origin, Dirs + i, FMath::Min(4, Num - i), Far, OutDistances + i);
+	}
+}
+
+void FStaticBVH::RayCast4(FVector const &Origin, FVector const* Dirs, int32 Num, float Far, float* OutDistances) const {
+	if (this->Nodes.Num() == 0) {
+		for (int32 Lane = 0; Lane < Num; ++Lane) {
+			OutDistances[Lane] = -1;
+		}
+		return;
+	}
+	/* One ray per lane, idle lanes repeat the first one so that they never widen the traversal */
+	auto SafeInverse = [](float x) {
+		return FMath::Abs(x) > 1e-8f ? 1.0f / x : (x < 0 ? -1e8f : 1e8f);
+	};
+	MS_ALIGN(16) float D[3][4] GCC_ALIGN(16);
+	MS_ALIGN(16) float Inv[3][4] GCC_ALIGN(16);
+	for (int32 Lane = 0; Lane < 4; ++Lane) {
+		FVector const& Dir = Dirs[Lane < Num ? Lane : 0];
+		for (int32 Axis = 0; Axis < 3; ++Axis) {
+			D[Axis][Lane] = Dir[Axis];
+			Inv[Axis][Lane] = SafeInverse(Dir[Axis]);
+		}
+	}
+	VectorRegister const DX = VectorLoadAligned(D[0]), DY = VectorLoadAligned(D[1]), DZ = VectorLoadAligned(D[2]);
+	VectorRegister const InvX = VectorLoadAligned(Inv[0]), InvY = VectorLoadAligned(Inv[1]), InvZ = VectorLoadAligned(Inv[2]);
+	VectorRegister const O = VectorLoadFloat3_W0(&Origin);
+	VectorRegister const Zero = VectorZero();
+	VectorRegister const One = VectorOne();
+	VectorRegister const MinDet = VectorSetFloat1(1e-12f);
+	VectorRegister Best = VectorSetFloat1(Far);
+	/* Near child first, by the direction of the first ray */
+	bool const Negative[3] = { Dirs[0].X < 0, Dirs[0].Y < 0, Dirs[0].Z < 0 };
+
+	int32 Stack[MaxDepth + 4];
+	int32 Depth = 0;
+	Stack[Depth++] = 0;
+	while (Depth > 0) {
+		int32 const Index = Stack[--Depth];
+		FNode const& Node = this->Nodes[Index];
+		/* Slab test of the four rays against the node box, clipped to the nearest hit so far */
+		VectorRegister const Lo = VectorSubtract(VectorLoadFloat3(&Node.Min), O);
+		VectorRegister const Hi = VectorSubtract(VectorLoadFloat3(&Node.Max), O);
+		VectorRegister const LoX = VectorMultiply(VectorReplicate(Lo, 0), InvX);
+		VectorRegister const HiX = VectorMultiply(VectorReplicate(Hi, 0), InvX);
+		VectorRegister const LoY = VectorMultiply(VectorReplicate(Lo, 1), InvY);
+		VectorRegister const HiY = VectorMultiply(VectorReplicate(Hi, 1), InvY);
+		VectorRegister const LoZ = VectorMultiply(VectorReplicate(Lo, 2), InvZ);
+		VectorRegister const HiZ = VectorMultiply(VectorReplicate(Hi, 2), InvZ);
+		VectorRegister const Enter = VectorMax(VectorMax(VectorMin(LoX, HiX), VectorMin(LoY, HiY)),
+			VectorMax(VectorMin(LoZ, HiZ), Zero));
+		VectorRegister const Exit = VectorMin(VectorMin(VectorMax(LoX, HiX), VectorMax(LoY, HiY)),
+			VectorMin(VectorMax(LoZ, HiZ), Best));
+		if (VectorMaskBits(VectorCompareGE(Exit, Enter)) == 0) {
+			continue;
+		}
+		if (!Node.IsLeaf()) {
+			bool const bFlip = Negative[-1 - Node.Count];
+			Stack[Depth++] = bFlip ? Index + 1 : Node.Index;
+			Stack[Depth++] = bFlip ? Node.Index : Index + 1;
+			continue;
+		}
+
+		for (int32 k = Node.Index; k < Node.Index + Node.Count; ++k) {
+			/* Moller-Trumbore, the terms that only depend on the shared origin in scalar */
+			FTriangle const& Tri = this->Triangles[k];
+			FVector const T = Origin - Tri.V0;
+			FVector const Q = T ^ Tri.E1;
+			VectorRegister const E2X = VectorSetFloat1(Tri.E2.X), E2Y = VectorSetFloat1(Tri.E2.Y), E2Z = VectorSetFloat1(Tri.E2.Z);
+			VectorRegister const PX = VectorSubtract(VectorMultiply(DY, E2Z), VectorMultiply(DZ, E2Y));
+			VectorRegister const PY = VectorSubtract(VectorMultiply(DZ, E2X), VectorMultiply(DX, E2Z));
+			VectorRegister const PZ = VectorSubtract(VectorMultiply(DX, E2Y), VectorMultiply(DY, E2X));
+			VectorRegister const Det = VectorMultiplyAdd(VectorSetFloat1(Tri.E1.X), PX,
+				VectorMultiplyAdd(VectorSetFloat1(Tri.E1.Y), PY, VectorMultiply(VectorSetFloat1(Tri.E1.Z), PZ)));
+			VectorRegister const InvDet = VectorReciprocalAccurate(Det);
+			VectorRegister const U = VectorMultiply(InvDet, VectorMultiplyAdd(VectorSetFloat1(T.X), PX,
+				VectorMultiplyAdd(VectorSetFloat1(T.Y), PY, VectorMultiply(VectorSetFloat1(T.Z), PZ))));
+			VectorRegister const V = VectorMultiply(InvDet, VectorMultiplyAdd(DX, VectorSetFloat1(Q.X),
+				VectorMultiplyAdd(DY, VectorSetFloat1(Q.Y), VectorMultiply(DZ, VectorSetFloat1(Q.Z)))));
+			VectorRegister const Dist = VectorMultiply(InvDet, VectorSetFloat1(Tri.E2 | Q));
+			VectorRegister const Hit = VectorBitwiseAnd(
+				VectorBitwiseAnd(VectorCompareGT(VectorAbs(Det), MinDet), VectorCompareGT(Best, Dist)),
+				VectorBitwiseAnd(
+					VectorBitwiseAnd(VectorCompareGE(U, Zero), VectorCompareGE(V, Zero)),
+					VectorBitwiseAnd(VectorCompareGE(One, VectorAdd(U, V)), VectorCompareGT(Dist, Zero))));
+			Best = VectorSelect(Hit, Dist, Best);
+		}
+	}
+
+	MS_ALIGN(16) float Nearest[4] GCC_ALIGN(16);
+	VectorStoreAligned(Best, Nearest);
+	for (int32 Lane = 0; Lane < Num; ++Lane) {
+		OutDistances[Lane] = Nearest[Lane] < Far ? Nearest[Lane] : -1;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UPersianStaticScene
+
+void UPersianStaticScene::Initialize(FSubsystemCollectionBase& Collection) {
+	Super::Initialize(Collection);
+	this->bBuilt = false;
+	this->ActorSpawnedHandle = this->GetWorld()->AddOnActorSpawnedHandler(
+		FOnActorSpawned::FDelegate::CreateUObject(this, &UPersianStaticScene::OnActorSpawned));
+	this->LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UPersianStaticScene::OnLevelAdded);
+	this->LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UPersianStaticScene::OnLevelRemoved);
+}
+
+void UPersianStaticScene::Deinitialize() {
+	this->GetWorld()->RemoveOnActorSpawnedHandler(this->ActorSpawnedHandle);
+	FWorldDelegates::LevelAddedToWorld.Remove(this->LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(this->LevelRemovedHandle);
+	this->Levels.Empty();
+	this->bBuilt = false;
+	SET_DWORD_STAT(STAT_PersianStaticBVHTriangles, 0);
+	Super::Deinitialize();
+}
+
+void UPersianStaticScene::OnWorldBeginPlay(UWorld& InWorld) {
+	Super::OnWorldBeginPlay(InWorld);
+	this->Rebuild();
+}
+
+UPersianStaticScene const* UPersianStaticScene::GetForQueries(UWorld* World) {
+	if (World == nullptr || CVarStaticBVH.GetValueOnAnyThread() == 0
+		|| PersianCollision::GetQueryChannel() != ECC_ForcedPerspective) {
+		return nullptr;
+	}
+	UPersianStaticScene const* Scene = World->GetSubsystem<UPersianStaticScene>();
+	return Scene != nullptr && Scene->IsBuilt() ? Scene : nullptr;
+}
+
+void UPersianStaticScene::Rebuild() {
+	check(IsInGameThread());
+	this->Levels.Reset();
+	for (ULevel* Level : this->GetWorld()->GetLevels()) {
+		if (Level != nullptr) {
+			this->BakeLevel(Level);
+		}
+	}
+	this->bBuilt = true;
+}
+
+void UPersianStaticScene::BakeLevel(ULevel* Level) {
+	check(IsInGameThread());
+	PERSIAN_SCOPED_TIMING(StaticBVHBuild);
+	double const Start = FPlatformTime::Seconds();
+	FLevelScene& Scene = this->Levels.FindOrAdd(Level);
+	Scene.BVH.Reset();
+	Scene.Unbaked.Reset();
+	for (AActor* Actor : Level->Actors) {
+		if (Actor == nullptr || Actor->IsPendingKill()) {
+			continue;
+		}
+		/* The registry may not have seen this level yet */
+		PersianCollision::ApplyActorTags(Actor);
+		TInlineComponentArray<UPrimitiveComponent*> Primitives(Actor);
+		for (UPrimitiveComponent* Primitive : Primitives) {
+			AddPrimitive(Scene, Primitive, true);
+		}
+	}
+	Scene.BVH.Build(CVarStaticBVHLeafSize.GetValueOnGameThread());
+	SET_DWORD_STAT(STAT_PersianStaticBVHTriangles, this->GetNumTriangles());
+	UE_LOG(LogPersianStartup, Log, TEXT("Static BVH of %s: %d triangles, %d nodes, %.1f KiB, %d primitives left to physics, built in %.2f ms"),
+		*Level->GetOuter()->GetName(), Scene.BVH.GetNumTriangles(), Scene.BVH.GetNumNodes(),
+		Scene.BVH.GetAllocatedSize() / 1024.0f, Scene.Unbaked.Num(), (FPlatformTime::Seconds() - Start) * 1000);
+}
+
+void UPersianStaticScene::RayCastBVH(FVector const &Origin, FVector const* Dirs, int32 Num, float Far, float* OutDistances) const {
+	for (int32 i = 0; i < Num; ++i) {
+		OutDistances[i] = -1;
+	}
+	TArray<float, TInlineAllocator<256>> LevelDistances;
+	LevelDistances.SetNumUninitialized(Num);
+	for (TPair<TWeakObjectPtr<ULevel>, FLevelScene> const& Level : this->Levels) {
+		if (Level.Value.BVH.GetNumNodes() == 0) {
+			continue;
+		}
+		Level.Value.BVH.RayCast(Origin, Dirs, Num, Far, LevelDistances.GetData());
+		for (int32 i = 0; i < Num; ++i) {
+			if (LevelDistances[i] >= 0 && (OutDistances[i] < 0 || LevelDistances[i] < OutDistances[i])) {
+				OutDistances[i] = LevelDistances[i];
+			}
+		}
+	}
+}
+
+int32 UPersianStaticScene::GetNumTriangles() const {
+	int32 Num = 0;
+	for (TPair<TWeakObjectPtr<ULevel>, FLevelScene> const& Level : this->Levels) {
+		Num += Level.Value.BVH.GetNumTriangles();
+	}
+	return Num;
+}
+
+int32 UPersianStaticScene::GetNumNodes() const {
+	int32 Num = 0;
+	for (TPair<TWeakObjectPtr<ULevel>, FLevelScene> const& Level : this->Levels) {
+		Num += Level.Value.BVH.GetNumNodes();
+	}
+	return Num;
+}
+
+SIZE_T UPersianStaticScene::GetAllocatedSize() const {
+	SIZE_T Size = this->Levels.GetAllocatedSize();
+	for (TPair<TWeakObjectPtr<ULevel>, FLevelScene> const& Level : this->Levels) {
+		Size += Level.Value.BVH.GetAllocatedSize() + Level.Value.Unbaked.GetAllocatedSize();
+	}
+	return Size;
+}
+
+int32 UPersianStaticScene::GetNumUnbaked() const {
+	int32 Num = 0;
+	for (TPair<TWeakObjectPtr<ULevel>, FLevelScene> const& Level : this->Levels) {
+		Num += Level.Value.Unbaked.Num();
+	}
+	return Num;
+}
+
+bool UPersianStaticScene::BakeMesh(FStaticBVH &BVH, UStaticMesh const* Mesh, FTransform const &ToWorld) {
+	if (Mesh == nullptr || Mesh->RenderData == nullptr || Mesh->RenderData->LODResources.Num() == 0) {
+		return false;
+	}
+	UBodySetup const* Body = Mesh->BodySetup;
+	if (Body == nullptr) {
+		/* No collision, nothing to bake */
+		return true;
+	}
+	if (Body->GetCollisionTraceFlag() == CTF_UseSimpleAsComplex) {
+		/* Complex traces go through the simple shapes, which the render triangles do not match */
+		return false;
+	}
+	/* The triangles the complex collision is cooked from */
+	int32 const LOD = FMath::Clamp(Mesh->LODForCollision, 0, Mesh->RenderData->LODResources.Num() - 1);
+	FStaticMeshLODResources& Resources = Mesh->RenderData->LODResources[LOD];
+	FPositionVertexBuffer& Positions = Resources.VertexBuffers.PositionVertexBuffer;
+	FIndexArrayView const Indices = Resources.IndexBuffer.GetArrayView();
+	/* Kept on the CPU in the editor, and in cooked builds with bAllowCPUAccess */
+	if (Positions.GetNumVertices() == 0 || Positions.GetVertexData() == nullptr || Indices.Num() == 0) {
+		return false;
+	}
+	FMatrix const Matrix = ToWorld.ToMatrixWithScale();
+	for (FStaticMeshSection const& Section : Resources.Sections) {
+		if (!Section.bEnableCollision) {
+			continue;
+		}
+		for (uint32 k = 0; k < Section.NumTriangles; ++k) {
+			int32 const First = Section.FirstIndex + 3 * k;
+			BVH.AddTriangle(Matrix.TransformPosition(Positions.VertexPosition(Indices[First])),
+				Matrix.TransformPosition(Positions.VertexPosition(Indices[First + 1])),
+				Matrix.TransformPosition(Positions.VertexPosition(Indices[First + 2])));
+		}
+	}
+	return true;
+}
+
+void UPersianStaticScene::AddPrimitive(FLevelScene &Scene, UPrimitiveComponent* Primitive, bool bBake) {
+	/* Movable primitives are found by the fallback overlap */
+	if (Primitive == nullptr || !Primitive->IsRegistered() || Primitive->Mobility == EComponentMobility::Movable) {
+		return;
+	}
+	if (bBake) {
+		if (!Primitive->IsQueryCollisionEnabled()
+			|| Primitive->GetCollisionResponseToChannel(ECC_ForcedPerspective) != ECR_Block) {
+			return;
+		}
+		/* Stationary primitives may be grabbed, only static ones are baked */
+		if (Primitive->Mobility == EComponentMobility::Static) {
+			bool bBaked = false;
+			if (UInstancedStaticMeshComponent const* Instances = Cast<UInstancedStaticMeshComponent>(Primitive)) {
+				/* Grabbable instances move as they are grabbed and settle, and the BVH is not refitted */
+				bBaked = !Instances->ComponentHasTag(APersianInstanceProxy::GrabbableTag);
+				for (int32 Item = 0; Item < Instances->GetInstanceCount() && bBaked; ++Item) {
+					FTransform ToWorld;
+					if (Instances->GetInstanceTransform(Item, ToWorld, true)) {
+						bBaked = BakeMesh(Scene.BVH, Instances->GetStaticMesh(), ToWorld);
+					}
+				}
+			} else if (UStaticMeshComponent const* Mesh = Cast<UStaticMeshComponent>(Primitive)) {
+				bBaked = BakeMesh(Scene.BVH, Mesh->GetStaticMesh(), Mesh->GetComponentTransform());
+			}
+			if (bBaked) {
+				return;
+			}
+		}
+	}
+	Scene.Unbaked.Add(Primitive);
+}
+
+void UPersianStaticScene::OnActorSpawned(AActor* Actor) {
+	/* Too late for the BVH, which is not refitted, and collision may still change: left to the fallback */
+	if (!this->bBuilt || Actor == nullptr || Actor->GetLevel() == nullptr) {
+		return;
+	}
+	/* Goes along with its level */
+	FLevelScene& Scene = this->Levels.FindOrAdd(Actor->GetLevel());
+	TInlineComponentArray<UPrimitiveComponent*> Primitives(Actor);
+	for (UPrimitiveComponent* Primitive : Primitives) {
+		AddPrimitive(Scene, Primitive, false);
+	}
+}
+
+void UPersianStaticScene::OnLevelAdded(ULevel* Level, UWorld* World) {
+	/* Levels already there are baked on BeginPlay, the others one by one as they stream in */
+	if (World == this->GetWorld() && this->bBuilt && Level != nullptr) {
+		this->BakeLevel(Level);
+	}
+}
+
+void UPersianStaticScene::OnLevelRemoved(ULevel* Level, UWorld* World) {
+	if (World == this->GetWorld() && this->bBuilt && Level != nullptr) {
+		this->Levels.Remove(Level);
+		SET_DWORD_STAT(STAT_PersianStaticBVHTriangles, this->GetNumTriangles());
+	}
+}
+
+void UPersianStaticScene::PrepareRays(FStaticRayQuery &Query, FVector const &Origin, FVector const* Dirs, int32 Num, float Far,
+	FCollisionQueryParams const &Params) const {
+	Query.Origin = Origin;
+	Query.Far = Far;
+	Query.Params = &Params;
+	Query.Candidates.Reset();
+	Query.bWorldTrace = false;
+	INC_DWORD_STAT_BY(STAT_PersianStaticBVHRays, Num);
+
+	/* The BVH first, its hits bound how far the fallback has to look */
+	Query.Distances.SetNumUninitialized(Num);
+	int32 const ChunkSize = PersianPlacement::GetRayChunkSize();
+	int32 const NumChunks = FMath::DivideAndRoundUp(Num, ChunkSize);
+	ParallelFor(NumChunks, [&](int32 Chunk) {
+		int32 const Begin = Chunk * ChunkSize;
+		this->RayCastBVH(Origin, Dirs + Begin, FMath::Min(Num, Begin + ChunkSize) - Begin, Far, Query.Distances.GetData() + Begin);
+	}, NumChunks <= 1);
+	FBox Bundle(Origin, Origin);
+	for (int32 i = 0; i < Num; ++i) {
+		Bundle += Origin + Dirs[i] * (Query.Distances[i] >= 0 ? Query.Distances[i] : Far);
+	}
+	ECollisionChannel const Channel = PersianCollision::GetQueryChannel();
+	TSet<UPrimitiveComponent const*> Seen;
+	auto AddCandidate = [&](UPrimitiveComponent* Primitive) {
+		bool bAlreadySeen = false;
+		Seen.Add(Primitive, &bAlreadySeen);
+		if (!bAlreadySeen) {
+			Query.Candidates.Emplace(Primitive, Primitive->Bounds.GetBox());
+			Query.bWorldTrace |= Primitive->IsA<UInstancedStaticMeshComponent>();
+		}
+	};
+
+	/* Movable primitives in one overlap around the bundle up to its BVH hits, the static ones are baked or in Unbaked */
+	FCollisionQueryParams DynamicParams(Params);
+	DynamicParams.MobilityType = EQueryMobilityType::Dynamic;
+	TArray<FOverlapResult> Overlaps;
+	this->GetWorld()->OverlapMultiByChannel(Overlaps, Bundle.GetCenter(), FQuat::Identity, Channel,
+		FCollisionShape::MakeBox(Bundle.GetExtent()), DynamicParams);
+	for (FOverlapResult const& Overlap : Overlaps) {
+		UPrimitiveComponent* Primitive = Overlap.GetComponent();
+		if (Primitive != nullptr && Overlap.bBlockingHit && Primitive->Mobility == EComponentMobility::Movable) {
+			AddCandidate(Primitive);
+		}
+	}
+
+	/* The query params do not reach LineTraceComponent, their filtering is done here */
+	for (TPair<TWeakObjectPtr<ULevel>, FLevelScene> const& Level : this->Levels) {
+		for (TWeakObjectPtr<UPrimitiveComponent> const& Weak : Level.Value.Unbaked) {
+			UPrimitiveComponent* Primitive = Weak.Get();
+			if (Primitive == nullptr || !Primitive->IsQueryCollisionEnabled()
+				|| Primitive->GetCollisionResponseToChannel(Channel) != ECR_Block
+				|| !Primitive->Bounds.GetBox().Intersect(Bundle)
+				|| Params.GetIgnoredComponents().Contains(Primitive->GetUniqueID())) {
+				continue;
+			}
+			AActor const* Owner = Primitive->GetOwner();
+			if (Owner != nullptr && Params.GetIgnoredActors().Contains(Owner->GetUniqueID())) {
+				continue;
+			}
+			AddCandidate(Primitive);
+		}
+	}
+	INC_DWORD_STAT_BY(STAT_PersianStaticBVHCandidates, Query.Candidates.Num());
+}
+
+void UPersianStaticScene::RayCast(FStaticRayQuery const &Query, int32 First, FVector const* Dirs, int32 Num, float* OutDistances) const {
+	FMemory::Memcpy(OutDistances, Query.Distances.GetData() + First, Num * sizeof(float));
+	if (Query.Candidates.Num() == 0) {
+		return;
+	}
+	/* Only up to the BVH hit, anything further is behind it */
+	UWorld* const World = this->GetWorld();
+	ECollisionChannel const Channel = PersianCollision::GetQueryChannel();
+	for (int32 i = 0; i < Num; ++i) {
+		float const Limit = OutDistances[i] >= 0 ? OutDistances[i] : Query.Far;
+		FVector const End = Query.Origin + Dirs[i] * Limit;
+		FHitResult Hit;
+		if (Query.bWorldTrace) {
+			if (World->LineTraceSingleByChannel(Hit, Query.Origin, End, Channel, *Query.Params) && !Hit.bStartPenetrating) {
+				OutDistances[i] = Hit.Distance;
+			}
+			continue;
+		}
+		FVector const Segment = End - Query.Origin;
+		FVector const OneOverSegment = Segment.Reciprocal();
+		for (TPair<UPrimitiveComponent*, FBox> const& Candidate : Query.Candidates) {
+			if (FMath::LineBoxIntersection(Candidate.Value, Query.Origin, End, Segment, OneOverSegment)
+				&& Candidate.Key->LineTraceComponent(Hit, Query.Origin, End, *Query.Params) && !Hit.bStartPenetrating
+				&& (OutDistances[i] < 0 || Hit.Distance < OutDistances[i])) {
+				OutDistances[i] = Hit.Distance;
+			}
+		}
+	}
+}
+
+void UPersianStaticScene::RayCastMulti(FVector const &Origin, FVector const* Dirs, int32 Num, float Far,
+	FCollisionQueryParams const &Params, float* OutDistances) const {
+	FStaticRayQuery Query;
+	this->PrepareRays(Query, Origin, Dirs, Num, Far, Params);
+	this->RayCast(Query, 0, Dirs, Num, OutDistances);
+}
@@ -0,0 +1,167 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PersianStaticScene.generated.h"
+
+class UPrimitiveComponent;
+class UStaticMesh;
+struct FCollisionQueryParams;
+
+/**
+ * Bounding volume hierarchy over world-space triangles, built once with a
+ * binned surface area heuristic and then only read.  Nodes take 32 bytes and
+ * are stored depth first, the left child right after its parent; leaves own a
+ * range of triangles kept in Moller-Trumbore form.  Rays are traced four at a
+ * time from a shared origin, one ray per vector register lane, both through
+ * the node boxes and the triangles.
+ */
+struct FStaticBVH
+{
+	/** Drops every triangle and node */
+	void Reset();
+	/** Queues the triangle A B C for the next Build */
+	void AddTriangle(FVector const &A, FVector const &B, FVector const &C);
+	/** Builds the hierarchy over the queued triangles, at most LeafSize of them per leaf */
+	void Build(int32 LeafSize);
+
+	/**
+	 * Distance from Origin along each unit direction Dirs[i] to the nearest
+	 * triangle closer than Far, from either side, or -1 when there is none.
+	 * Any thread.
+	 */
+	void RayCast(FVector const &Origin, FVector const* Dirs, int32 Num, float Far, float* OutDistances) const;
+
+	int32 GetNumTriangles() const { return this->Triangles.Num(); }
+	int32 GetNumNodes() const { return this->Nodes.Num(); }
+	SIZE_T GetAllocatedSize() const { return this->Triangles.GetAllocatedSize() + this->Nodes.GetAllocatedSize(); }
+
+private:
+	struct FNode
+	{
+		FVector Min;
+		/* Leaf: first triangle.  Inner node: right child */
+		int32 Index;
+		FVector Max;
+		/* Leaf: number of triangles.  Inner node: -1 - split axis */
+		int32 Count;
+
+		bool IsLeaf() const { return this->Count > 0; }
+	};
+	static_assert(sizeof(FNode) == 32, "Two nodes per cache line");
+
+	/* One vertex and the two edges from it */
+	struct FTriangle
+	{
+		FVector V0;
+		FVector E1;
+		FVector E2;
+	};
+
+	TArray<FNode> Nodes;
+	TArray<FTriangle> Triangles;
+	/* Corners of the triangles queued by AddTriangle, three per triangle */
+	TArray<FVector> Pending;
+
+	int32 BuildNode(TArray<int32> &Order, TArray<FBox> const &Bounds, TArray<FVector> const &Centers,
+		int32 Begin, int32 End, int32 LeafSize, int32 Depth);
+	void RayCast4(FVector const &Origin, FVector const* Dirs, int32 Num, float Far, float* OutDistances) const;
+};
+
+/** What a bundle of rays from one origin tests besides the BVH, see UPersianStaticScene::PrepareRays */
+struct FStaticRayQuery
+{
+	FVector Origin = FVector::ZeroVector;
+	float Far = 0;
+	/* Must outlive the query */
+	FCollisionQueryParams const* Params = nullptr;
+	/* BVH hit of each ray of the bundle, -1 when there is none */
+	TArray<float> Distances;
+	/* Blocking primitives around the bundle the BVH does not hold, with their world bounds */
+	TArray<TPair<UPrimitiveComponent*, FBox>> Candidates;
+	/* Some of them are instanced, which LineTraceComponent does not go through: trace the world instead */
+	bool bWorldTrace = false;
+};
+
+/**
+ * Answers the placement rays against the static part of the level without
+ * going through the physics scene.  The triangles of every static mesh
+ * component of static mobility that blocks ECC_ForcedPerspective, instances
+ * included, are baked into one FStaticBVH per level as the level is added,
+ * and dropped along with it, so that streaming a room only bakes that room.
+ * Movable primitives, grabbable instances, and the static ones that could not
+ * be baked, are left to a small fallback query: one overlap around the bundle
+ * of rays up to their BVH hits, then per ray only the few primitives whose
+ * bounds the ray crosses before its BVH hit.
+ */
+UCLASS()
+class UPersianStaticScene : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+
+	/**
+	 * The static scene of World when the placement rays may go through it:
+	 * built, enabled by persian.StaticBVH, and the queries on
+	 * ECC_ForcedPerspective, which the BVH was baked for.  Null otherwise.
+	 */
+	static UPersianStaticScene const* GetForQueries(UWorld* World);
+
+	/** Bakes the BVH of every loaded level again.  Game thread */
+	void Rebuild();
+	bool IsBuilt() const { return this->bBuilt; }
+	/** Distance to the nearest baked triangle of any level, as FStaticBVH::RayCast.  Any thread */
+	void RayCastBVH(FVector const &Origin, FVector const* Dirs, int32 Num, float Far, float* OutDistances) const;
+	int32 GetNumTriangles() const;
+	int32 GetNumNodes() const;
+	SIZE_T GetAllocatedSize() const;
+	/** Static blocking primitives traced by the fallback, e.g. landscape, BSP, grabbable instances or meshes without CPU-side data */
+	int32 GetNumUnbaked() const;
+
+	/**
+	 * Casts the rays Dirs from Origin through the BVH and gathers, once for
+	 * the whole bundle, what they test besides it.  Game thread
+	 */
+	void PrepareRays(FStaticRayQuery &Query, FVector const &Origin, FVector const* Dirs, int32 Num, float Far,
+		FCollisionQueryParams const &Params) const;
+	/**
+	 * Distance along the unit directions Dirs[0, Num) of a prepared bundle,
+	 * rays First to First + Num of it, to the first blocking hit closer than
+	 * Query.Far, or -1 when there is none.  Any thread, within
+	 * FPhysicsCommand::ExecuteRead when called from a worker.
+	 */
+	void RayCast(FStaticRayQuery const &Query, int32 First, FVector const* Dirs, int32 Num, float* OutDistances) const;
+	/** PrepareRays then RayCast on the whole bundle */
+	void RayCastMulti(FVector const &Origin, FVector const* Dirs, int32 Num, float Far,
+		FCollisionQueryParams const &Params, float* OutDistances) const;
+
+private:
+	/* What one level adds to the static scene */
+	struct FLevelScene
+	{
+		FStaticBVH BVH;
+		TArray<TWeakObjectPtr<UPrimitiveComponent>> Unbaked;
+	};
+	TMap<TWeakObjectPtr<ULevel>, FLevelScene> Levels;
+	bool bBuilt;
+	FDelegateHandle ActorSpawnedHandle;
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+
+	/* Bakes the BVH of Level again */
+	void BakeLevel(ULevel* Level);
+	/* Adds the collision triangles of Mesh placed at ToWorld to BVH, false when they cannot be read */
+	static bool BakeMesh(FStaticBVH &BVH, UStaticMesh const* Mesh, FTransform const &ToWorld);
+	/* Bakes Primitive into Scene when bBake, or leaves it to the fallback unless it is movable */
+	static void AddPrimitive(FLevelScene &Scene, UPrimitiveComponent* Primitive, bool bBake);
+
+	void OnActorSpawned(AActor* Actor);
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+};
@@ -0,0 +1,41 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+/*
+ * Performance tests, run by CI with e.g.
+ * `-nullrhi -unattended -ExecCmds="Automation RunTests Persian.Bench; Quit" -PersianBaseline=<summary csv>`.
+ */
+
+#include "PersianTestWorld.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "ForcedPerspectiveComponent.h"
+#include "PersianBenchmarks.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/CommandLine.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPersianBenchAttachReleaseTest, "Persian.Bench.AttachRelease",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::PerfFilter)
+
+bool FPersianBenchAttachReleaseTest::RunTest(FString const& Parameters) {
+	FPersianTestWorld TestWorld;
+	TestWorld.BeginPlay();
+	UForcedPerspectiveComponent* Holder = TestWorld.SpawnHolder(FVector(0, 0, 100), FRotator::ZeroRotator);
+
+	/* Same knobs as persian.Bench.AttachRelease, from the command line */
+	TCHAR const* CommandLine = FCommandLine::Get();
+	PersianBench::FAttachReleaseOptions Options;
+	Options.VertexCounts = PersianBench::ParseCountList(CommandLine, TEXT("PersianBenchVertices="), TEXT("100,1000,10000,100000"));
+	FParse::Value(CommandLine, TEXT("PersianBenchIterations="), Options.Iterations);
+	FParse::Value(CommandLine, TEXT("PersianBaseline="), Options.BaselinePath);
+	FParse::Value(CommandLine, TEXT("PersianThreshold="), Options.Threshold);
+
+	TArray<FString> Errors;
+	bool const bPassed = PersianBench::RunAttachRelease(TestWorld.GetWorld(), Holder, Holder->ViewComponent, Options, Errors);
+	for (FString const& Error : Errors) {
+		AddError(Error);
+	}
+	return bPassed;
+}
+
+#endif
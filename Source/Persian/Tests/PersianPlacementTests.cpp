@@ -0,0 +1,83 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+/*
+ * Automation tests of the placement solvers, run from the session frontend or
+ * with `-ExecCmds="Automation RunTests Persian.Placement"`.
+ */
+
+#include "PersianTestWorld.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "ForcedPerspectiveComponent.h"
+#include "Engine/StaticMeshActor.h"
+#include "GameFramework/RotatingMovementComponent.h"
+#include "Misc/AutomationTest.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPersianSweepMatchesRaysTest, "Persian.Placement.SweepMatchesRays",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::ProductFilter)
+
+bool FPersianSweepMatchesRaysTest::RunTest(FString const& Parameters) {
+	FPersianTestWorld TestWorld;
+	/* Wall facing the holder, its front face 1000 units away */
+	TestWorld.SpawnBox(FVector(1100, 0, 100), FVector(2, 20, 20), EComponentMobility::Static);
+	TestWorld.BeginPlay();
+
+	UForcedPerspectiveComponent* Holder = TestWorld.SpawnHolder(FVector(0, 0, 100), FRotator::ZeroRotator);
+	/* A cube: its bounding box is the mesh itself, the swept box and the rays see the same shape */
+	AStaticMeshActor* Prop = TestWorld.SpawnBox(FVector(300, 0, 100), FVector(0.25), EComponentMobility::Movable);
+	if (!TestTrue(TEXT("The cube attaches"), Holder->Attach(Prop, FVector(287.5, 0, 100)))) {
+		return false;
+	}
+	Prop->SetActorEnableCollision(false);
+
+	double const Far = 50000;
+	double const RayScale = Holder->SolvePlacementScale(Holder->GetDirections(), Far);
+	double const SweepScale = Holder->SolveSweepScale(Far);
+	/* Front face from 287.5 to 1000 units */
+	TestTrue(TEXT("The rays reach the wall"), FMath::IsNearlyEqual(RayScale, 1000 / 287.5, 0.05 * RayScale));
+	TestTrue(FString::Printf(TEXT("Sweep scale %f within 5%% of ray scale %f"), SweepScale, RayScale),
+		FMath::IsNearlyEqual(SweepScale, RayScale, 0.05 * RayScale));
+	Holder->Detach();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPersianHeldPoseMatchesViewTest, "Persian.Placement.HeldPoseMatchesView",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::ProductFilter)
+
+bool FPersianHeldPoseMatchesViewTest::RunTest(FString const& Parameters) {
+	FPersianTestWorld TestWorld;
+	TestWorld.BeginPlay();
+
+	UForcedPerspectiveComponent* Holder = TestWorld.SpawnHolder(FVector(0, 0, 100), FRotator::ZeroRotator);
+	AActor* Viewer = Holder->GetOwner();
+	/* The view keeps turning, as late in the frame as a camera update would */
+	URotatingMovementComponent* Turn = NewObject<URotatingMovementComponent>(Viewer);
+	Turn->RotationRate = FRotator(0, 90, 0);
+	Turn->PrimaryComponentTick.TickGroup = TG_PostPhysics;
+	Turn->RegisterComponent();
+
+	AStaticMeshActor* Prop = TestWorld.SpawnBox(FVector(300, 0, 100), FVector(0.25), EComponentMobility::Movable);
+	if (!TestTrue(TEXT("The cube attaches"), Holder->Attach(Prop, FVector(287.5, 0, 100)))) {
+		return false;
+	}
+	TestTrue(TEXT("The held tick runs while holding"), Holder->IsComponentTickEnabled());
+
+	for (int32 Frame = 0; Frame < 4; Frame++) {
+		FRotator const Before = Holder->GetViewTransform().Rotator();
+		TestWorld.Tick(1 / 60.f);
+		FTransform const View = Holder->GetViewTransform();
+		TestFalse(TEXT("The view turned this frame"), View.Rotator().Equals(Before, 0.1f));
+		/* Placed for the view the frame ends with, not the one it started with */
+		FTransform const Expected = Holder->ComputeHeldTransform(Holder->GetHeldScale());
+		TestTrue(FString::Printf(TEXT("Frame %d: held at %s, view expects %s"), Frame,
+				*Prop->GetActorLocation().ToString(), *Expected.GetLocation().ToString()),
+			Prop->GetActorTransform().Equals(Expected, 0.1f));
+	}
+
+	Holder->Detach();
+	TestFalse(TEXT("The held tick stops with the hold"), Holder->IsComponentTickEnabled());
+	return true;
+}
+
+#endif
@@ -0,0 +1,63 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "PersianTestWorld.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "ForcedPerspectiveComponent.h"
+#include "Camera/CameraActor.h"
+#include "Camera/CameraComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "GameFramework/WorldSettings.h"
+
+FPersianTestWorld::FPersianTestWorld() {
+	this->World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("PersianTestWorld"));
+	GEngine->CreateNewWorldContext(EWorldType::Game).SetCurrentWorld(this->World);
+	this->World->InitializeActorsForPlay(FURL());
+	this->Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+}
+
+FPersianTestWorld::~FPersianTestWorld() {
+	GEngine->DestroyWorldContext(this->World);
+	this->World->DestroyWorld(false);
+}
+
+AStaticMeshActor* FPersianTestWorld::SpawnBox(FVector const &Center, FVector const &Scale, EComponentMobility::Type Mobility) {
+	/* Set up before the components register, static ones cannot take a mesh or a transform afterwards */
+	FTransform const Transform(FRotator::ZeroRotator, Center, Scale);
+	AStaticMeshActor* Box = this->World->SpawnActorDeferred<AStaticMeshActor>(AStaticMeshActor::StaticClass(), Transform,
+		nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	UStaticMeshComponent* Mesh = Box->GetStaticMeshComponent();
+	Mesh->SetMobility(Mobility);
+	Mesh->SetStaticMesh(this->Cube);
+	Mesh->SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
+	Box->FinishSpawning(Transform);
+	return Box;
+}
+
+void FPersianTestWorld::BeginPlay() {
+	this->World->BeginPlay();
+	/* No game mode here to start play on the actors */
+	this->World->GetWorldSettings()->NotifyBeginPlay();
+}
+
+UForcedPerspectiveComponent* FPersianTestWorld::SpawnHolder(FVector const &Location, FRotator const &Rotation) {
+	ACameraActor* Viewer = this->World->SpawnActor<ACameraActor>(Location, Rotation);
+	UForcedPerspectiveComponent* Holder = NewObject<UForcedPerspectiveComponent>(Viewer);
+	Holder->ViewComponent = Viewer->GetCameraComponent();
+	Holder->RegisterComponent();
+	return Holder;
+}
+
+void FPersianTestWorld::Tick(float DeltaSeconds, int32 Frames) {
+	for (int32 i = 0; i < Frames; i++) {
+		this->World->Tick(LEVELTICK_All, DeltaSeconds);
+	}
+}
+
+#endif
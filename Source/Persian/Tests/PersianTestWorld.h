@@ -0,0 +1,43 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Components/SceneComponent.h"
+
+class AStaticMeshActor;
+class UForcedPerspectiveComponent;
+class UStaticMesh;
+class UWorld;
+
+/**
+ * Standalone game world for the automation tests.  Boxes of static mobility
+ * are spawned before BeginPlay, so that they are baked into the static scene;
+ * everything else once it has begun play.
+ */
+class FPersianTestWorld
+{
+public:
+	FPersianTestWorld();
+	~FPersianTestWorld();
+
+	UWorld* GetWorld() const { return this->World; }
+
+	/** Engine cube, 100 units wide, scaled by Scale and centred on Center */
+	AStaticMeshActor* SpawnBox(FVector const &Center, FVector const &Scale, EComponentMobility::Type Mobility);
+	/** Begins play: the static scene is baked from the boxes spawned so far */
+	void BeginPlay();
+	/** Camera actor at Location looking along Rotation, holding from its camera */
+	UForcedPerspectiveComponent* SpawnHolder(FVector const &Location, FRotator const &Rotation);
+	/** Ticks the whole world Frames times */
+	void Tick(float DeltaSeconds, int32 Frames = 1);
+
+private:
+	UWorld* World;
+	UStaticMesh* Cube;
+};
+
+#endif